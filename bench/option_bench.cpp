@@ -0,0 +1,111 @@
+// Option<T> vs std::optional<T> on the token hot path: moving a Token out of
+// a vector into an Option and back into another vector, like pop_token and
+// Block::collect_values do.
+#define STDCPP_IMPLEMENTATION
+#include <stdcpp.hpp>
+#include <optional>
+#include <chrono>
+
+static_assert(std::is_trivially_copyable_v<Option<int>>);
+static_assert(std::is_trivially_destructible_v<Option<float>>);
+static_assert(std::is_trivially_copyable_v<Option<std::string&>>);
+static_assert(sizeof(Option<int>) == sizeof(std::optional<int>));
+static_assert(sizeof(Option<std::string>) == sizeof(std::optional<std::string>));
+static_assert(sizeof(Option<std::string&>) == sizeof(std::string*));
+
+struct Loc{
+  int col{0}, row{0};
+  std::string file_path;
+};
+
+struct Token{
+  int type{0};
+  std::string value;
+  Loc loc;
+};
+
+template <typename Opt>
+Opt pop_token(std::vector<Token>& tokens, size_t& cursor){
+  Opt res;
+  if (cursor < tokens.size()){
+    res.emplace(std::move(tokens[cursor++]));
+  }
+  return res;
+}
+
+template <typename Opt>
+Token& get(Opt& o){
+  if constexpr (requires { o.unwrap(); }) return o.unwrap();
+  else return *o;
+}
+
+std::vector<Token> make_tokens(size_t n){
+  std::vector<Token> res(n);
+  for (size_t i = 0; i < n; ++i){
+    res[i].type = int(i % 20);
+    res[i].value = (i % 3 == 0) ? "a_fairly_long_identifier_name" : "x";
+    res[i].loc = {int(i % 80), int(i / 80), "/home/user/project/src/main.hash"};
+  }
+  return res;
+}
+
+template <typename Opt>
+double bench_tokens(size_t n, int reps, size_t& checksum){
+  double best = 1e30;
+  for (int r = 0; r < reps; ++r){
+    std::vector<Token> tokens = make_tokens(n);
+    std::vector<Token> collected;
+    collected.reserve(n);
+    size_t cursor = 0;
+    auto start = std::chrono::steady_clock::now();
+    Opt T;
+    do {
+      T = pop_token<Opt>(tokens, cursor);
+      if (!T) break;
+      Token& token = get(T);
+      checksum += token.value.size();
+      collected.push_back(std::move(token));
+    } while (T);
+    auto end = std::chrono::steady_clock::now();
+    best = std::min(best, std::chrono::duration<double, std::nano>(end - start).count() / double(n));
+  }
+  return best;
+}
+
+int get_int(Option<int>& o){ return o.unwrap(); }
+int get_int(std::optional<int>& o){ return *o; }
+
+template <typename Opt>
+double bench_ints(size_t n, int reps, size_t& checksum){
+  std::vector<int> values(n);
+  for (size_t i = 0; i < n; ++i) values[i] = int(i * 7);
+  double best = 1e30;
+  for (int r = 0; r < reps; ++r){
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < n; ++i){
+      Opt o;
+      if (values[i] % 3 != 0) o = values[i];
+      if (o) checksum += size_t(get_int(o));
+    }
+    auto end = std::chrono::steady_clock::now();
+    best = std::min(best, std::chrono::duration<double, std::nano>(end - start).count() / double(n));
+  }
+  return best;
+}
+
+int main(int argc, char *argv[]) {
+  size_t n = 1'000'000;
+  int reps = 10;
+  size_t checksum = 0;
+
+  double opt_tok = bench_tokens<Option<Token>>(n, reps, checksum);
+  double std_tok = bench_tokens<std::optional<Token>>(n, reps, checksum);
+  double opt_int = bench_ints<Option<int>>(n, reps, checksum);
+  double std_int = bench_ints<std::optional<int>>(n, reps, checksum);
+
+  print("{:<28}{:>14}{:>22}\n", "case", "Option ns/op", "std::optional ns/op");
+  print("{:<28}{:>14.2f}{:>22.2f}\n", "pop Token", opt_tok, std_tok);
+  print("{:<28}{:>14.2f}{:>22.2f}\n", "Option<int> assign/test", opt_int, std_int);
+  print("checksum: {}\n", checksum);
+  return 0;
+}
@@ -0,0 +1,529 @@
+// Microbenchmarks for every helper in stdcpp.hpp at input sizes from 1 KB to
+// 100 MB. Sizes run smallest first; once a case goes over the time budget, or
+// its measured growth projects that the next size will, the larger sizes are
+// skipped and reported as such. That is where the quadratic helpers show up.
+// Each case reports min/median/mean/stddev ns per call over --reps samples,
+// on stdout and as JSON in --json.
+//
+// usage: stdcpp_bench [--reps N] [--budget-ms MS] [--cpu N] [--max-size BYTES]
+//                     [--filter SUBSTR] [--json FILE]
+#define STDCPP_IMPLEMENTATION
+#include <stdcpp.hpp>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <sstream>
+
+#if defined(__linux__)
+#include <sched.h>
+#include <fcntl.h>
+#include <unistd.h>
+#elif defined(_WIN32)
+#include <windows.h>
+#endif
+
+#define KB (size_t(1) << 10)
+#define MB (size_t(1) << 20)
+
+static const size_t sizes[] = {1*KB, 32*KB, 1*MB, 16*MB, 100*MB};
+
+struct Config{
+  int reps{5};
+  double budget_ms{2000.0};
+  double min_sample_ms{20.0};
+  int cpu{0};
+  size_t max_size{100*MB};
+  std::string filter;
+  std::string json_path{"stdcpp_bench.json"};
+};
+
+// What a case hands back for one input size. `prepare` runs untimed before
+// every call (e.g. dropping the page cache), which forces one call per sample.
+struct Body{
+  std::function<size_t()> run;
+  std::function<void()> prepare;
+};
+
+struct Case{
+  std::string name;
+  std::string unit; // what the size counts: "bytes" or "calls"
+  std::function<Body(size_t n)> make;
+  size_t max_n{SIZE_MAX};
+};
+
+struct Result{
+  std::string name;
+  std::string unit;
+  size_t n{0};
+  size_t iters{0};
+  int reps{0};
+  double min{0}, median{0}, mean{0}, stddev{0}; // ns per call
+  double growth{0};                             // log-log slope vs the previous size
+  std::string note;
+};
+
+static volatile size_t sink;
+
+// Inputs ----------------------------------------
+static uint64_t lcg_state = 0x2545F4914F6CDD1Dull;
+static uint32_t lcg(){
+  lcg_state = lcg_state * 6364136223846793005ull + 1442695040888963407ull;
+  return uint32_t(lcg_state >> 33);
+}
+
+// Lowercase words and spaces with a newline roughly every 64 bytes; no digits
+// and no '#', so the predicate and char searches below scan to the end.
+static std::string make_text(size_t n){
+  std::string res(n, ' ');
+  size_t line = 0;
+  for (size_t i = 0; i < n; ++i, ++line){
+    uint32_t r = lcg();
+    if (line >= 64 && r % 4 == 0){ res[i] = '\n'; line = 0; }
+    else if (r % 7 == 0) res[i] = ' ';
+    else res[i] = char('a' + (r >> 8) % 26);
+  }
+  return res;
+}
+
+// Text with n/8 bytes of whitespace on both ends, for the trim helpers.
+static std::string make_padded(size_t n){
+  size_t pad = n / 8;
+  return std::string(pad, ' ') + make_text(n - 2*pad) + std::string(pad, ' ');
+}
+
+#define NEEDLE "needle"
+
+struct Null_buf : std::streambuf{
+  int overflow(int c) override { return c; }
+  std::streamsize xsputn(const char*, std::streamsize n) override { return n; }
+};
+
+static std::filesystem::path temp_file(size_t n){
+  return std::filesystem::temp_directory_path() / FMT("stdcpp_bench_{}.txt", n);
+}
+
+static void write_file(const std::filesystem::path& path, const std::string& data){
+  std::ofstream ofs(path, std::ios::binary);
+  ofs << data;
+}
+
+#if defined(__linux__)
+static void drop_page_cache(const std::filesystem::path& path){
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) return;
+  fdatasync(fd);
+  posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+  close(fd);
+}
+#endif
+
+// Cases ----------------------------------------
+// A string helper taking its input by value: the copy is part of the call,
+// the same as it is for every caller.
+#define STR_CASE(label, input, expr)					\
+  cases.push_back({label, "bytes", [](size_t n){			\
+    auto s = std::make_shared<std::string>(input(n));			\
+    return Body{[s]{ return size_t(expr.size()); }};			\
+  }})
+
+#define SV_CASE(label, input, expr)					\
+  cases.push_back({label, "bytes", [](size_t n){			\
+    auto s = std::make_shared<std::string>(input(n));			\
+    return Body{[s]{ std::string_view v{*s}; return size_t(expr.size()); }}; \
+  }})
+
+#define LOOP_CASE(label, expr)						\
+  cases.push_back({label, "calls", [](size_t n){			\
+    return Body{[n]{ size_t acc = 0; for (size_t i = 0; i < n; ++i) acc += size_t(expr); return acc; }}; \
+  }})
+
+#define CH_CASE(fn)							\
+  cases.push_back({"ch::" #fn, "bytes", [](size_t n){			\
+    auto s = std::make_shared<std::string>(make_text(n));		\
+    return Body{[s]{ size_t acc = 0; for (const char& c : *s) acc += ch::fn(c); return acc; }}; \
+  }})
+
+static std::string with_needle_at_end(size_t n){ return make_text(n - std::strlen(NEEDLE)) + NEEDLE; }
+static std::string with_needle_at_start(size_t n){ return NEEDLE + make_text(n - std::strlen(NEEDLE)); }
+
+// n rects of 1..20 units, scattered so the density stays the same at every n.
+static std::shared_ptr<math::Rect_batch> make_rects(size_t n){
+  auto batch = std::make_shared<math::Rect_batch>();
+  float side = std::sqrt(float(n)) * 20.f;
+  batch->reserve(n);
+  for (size_t i = 0; i < n; ++i){
+    batch->push({math::randomf(0.f, side), math::randomf(0.f, side), math::randomf(1.f, 20.f), math::randomf(1.f, 20.f)});
+  }
+  return batch;
+}
+
+static std::vector<Case> make_cases(){
+  std::vector<Case> cases;
+
+  CH_CASE(isspace);
+  CH_CASE(isalpha);
+  CH_CASE(isalphanum);
+  CH_CASE(isdigit);
+
+  STR_CASE("str::tolower", make_text, str::tolower(*s));
+  STR_CASE("str::toupper", make_text, str::toupper(*s));
+  STR_CASE("str::rtrim", make_padded, str::rtrim(*s));
+  STR_CASE("str::ltrim", make_padded, str::ltrim(*s));
+  STR_CASE("str::trim", make_padded, str::trim(*s));
+  STR_CASE("str::split_by", make_text, str::split_by(*s, '\n'));
+  STR_CASE("str::lremove(n/2)", make_text, str::lremove(*s, s->size()/2));
+  STR_CASE("str::rremove(n/2)", make_text, str::rremove(*s, s->size()/2));
+  STR_CASE("str::lremove_until(pred)", make_padded, str::lremove_until(*s, ch::isspace));
+  STR_CASE("str::rremove_until(pred)", make_padded, str::rremove_until(*s, ch::isspace));
+  STR_CASE("str::lremove_until(str)", with_needle_at_end, str::lremove_until(*s, std::string(NEEDLE)));
+  STR_CASE("str::rremove_until(str)", with_needle_at_start, str::rremove_until(*s, std::string(NEEDLE)));
+  STR_CASE("str::remove_char", make_text, str::remove_char(*s, ' '));
+  STR_CASE("str::replace", make_text, str::replace(*s, " ", "__"));
+  STR_CASE("str::lpop(n/2)", make_text, str::lpop(*s, s->size()/2));
+  STR_CASE("str::rpop(n/2)", make_text, str::rpop(*s, s->size()/2));
+  STR_CASE("str::lpop_until(char)", make_text, str::lpop_until(*s, '#'));
+  STR_CASE("str::lpop_until(pred)", make_text, str::lpop_until(*s, ch::isdigit));
+  STR_CASE("str::rpop_until(char)", make_text, str::rpop_until(*s, '#'));
+  STR_CASE("str::rpop_until(pred)", make_text, str::rpop_until(*s, ch::isdigit));
+
+  SV_CASE("sv::rtrim", make_padded, sv::rtrim(v));
+  SV_CASE("sv::ltrim", make_padded, sv::ltrim(v));
+  SV_CASE("sv::trim", make_padded, sv::trim(v));
+  SV_CASE("sv::lremove(n/2)", make_text, sv::lremove(v, v.size()/2));
+  SV_CASE("sv::rremove(n/2)", make_text, sv::rremove(v, v.size()/2));
+  SV_CASE("sv::lremove_until(pred)", make_padded, sv::lremove_until(v, ch::isspace));
+  SV_CASE("sv::rremove_until(pred)", make_padded, sv::rremove_until(v, ch::isspace));
+  SV_CASE("sv::lremove_until(sv)", with_needle_at_end, sv::lremove_until(v, NEEDLE));
+  SV_CASE("sv::rremove_until(sv)", with_needle_at_start, sv::rremove_until(v, NEEDLE));
+
+  LOOP_CASE("math::randomf", math::randomf(0.f, 1.f) < 0.5f);
+  LOOP_CASE("math::randomi", math::randomi(0, 100));
+  LOOP_CASE("math::Xoshiro256::next", math::rng().next() & 1);
+  LOOP_CASE("math::Pcg32::next", [] { static math::Pcg32 pcg; return pcg.next() & 1; }());
+  LOOP_CASE("math::bounded", math::bounded(math::rng(), 1000u));
+  cases.push_back({"math::fill_uniform", "calls", [](size_t n){
+    auto out = std::make_shared<std::vector<float>>(n);
+    return Body{[out]{ math::fill_uniform(out->data(), out->size(), -1.f, 1.f); return size_t(out->back() > 0.f); }};
+  }, 16*MB});
+  LOOP_CASE("math::rad2deg", math::rad2deg(float(i)) > 90.f);
+  LOOP_CASE("math::deg2rad", math::deg2rad(float(i)) > 1.f);
+  LOOP_CASE("math::map", math::map(float(i & 1023), 0.f, 1024.f, -1.f, 1.f) > 0.f);
+  LOOP_CASE("math::chance", math::chance(25.f));
+  LOOP_CASE("math::rect_intersects_rect",
+	    math::rect_intersects_rect(float(i & 1023), float((i >> 10) & 1023), 16.f, 16.f,
+				       512.f, 512.f, 64.f, 64.f));
+  LOOP_CASE("math::rect_contains_rect",
+	    math::rect_contains_rect(512.f, 512.f, 64.f, 64.f,
+				     float(i & 1023), float((i >> 10) & 1023), 16.f, 16.f));
+
+  cases.push_back({"math::intersects_mask", "calls", [](size_t n){
+    auto batch = make_rects(n);
+    auto mask = std::make_shared<std::vector<uint64_t>>();
+    return Body{[batch, mask]{ return math::intersects_mask({100.f, 100.f, 200.f, 200.f}, *batch, *mask); }};
+  }, 16*MB});
+  cases.push_back({"math::intersecting_pairs", "calls", [](size_t n){
+    auto batch = make_rects(n);
+    auto pairs = std::make_shared<std::vector<std::pair<uint32_t, uint32_t>>>();
+    return Body{[batch, pairs]{ pairs->clear(); return math::intersecting_pairs(*batch, *pairs); }};
+  }, 16*MB});
+  cases.push_back({"math::Rect_grid build+pairs", "calls", [](size_t n){
+    auto batch = make_rects(n);
+    auto pairs = std::make_shared<std::vector<std::pair<uint32_t, uint32_t>>>();
+    return Body{[batch, pairs]{
+      math::Rect_grid grid;
+      grid.build(*batch);
+      pairs->clear();
+      return grid.pairs(*batch, *pairs);
+    }};
+  }, 16*MB});
+
+  LOOP_CASE("Option::emplace/unwrap", [i]{ Option<size_t> o; if (i % 3) o.emplace(i); return o ? o.unwrap() : 0; }());
+  LOOP_CASE("Option::map", Option<size_t>(i).map([](size_t x){ return x * 2; }).unwrap());
+  LOOP_CASE("Option::and_then", Option<size_t>(i).and_then([](size_t x){ return x % 2 ? Option<size_t>(x) : Option<size_t>(); }).has_value());
+  LOOP_CASE("Option<std::string>", [i]{ Option<std::string> o; if (i % 3) o.emplace("a_fairly_long_identifier_name"); return o ? o.unwrap().size() : 0; }());
+
+  // n 32-byte allocations, then all of them released.
+  cases.push_back({"new/delete 32B", "calls", [](size_t n){
+    auto ptrs = std::make_shared<std::vector<void*>>(n);
+    return Body{[ptrs]{
+      for (auto& p : *ptrs) p = ::operator new(32);
+      for (auto p : *ptrs) ::operator delete(p);
+      return ptrs->size();
+    }};
+  }, 16*MB});
+  cases.push_back({"arena::Pool 32B", "calls", [](size_t n){
+    auto pool = std::make_shared<arena::Pool>(32);
+    auto ptrs = std::make_shared<std::vector<void*>>(n);
+    return Body{[pool, ptrs]{
+      for (auto& p : *ptrs) p = pool->allocate(32);
+      for (auto p : *ptrs) pool->deallocate(p, 32);
+      return ptrs->size();
+    }};
+  }, 16*MB});
+  cases.push_back({"arena::Chunked_arena 32B", "calls", [](size_t n){
+    auto a = std::make_shared<arena::Chunked_arena>();
+    return Body{[a, n]{
+      size_t acc = 0;
+      for (size_t i = 0; i < n; ++i) acc += size_t(a->allocate(32)) & 1;
+      a->reset();
+      return acc;
+    }};
+  }, 16*MB});
+  cases.push_back({"arena::Bump_arena 32B", "calls", [](size_t n){
+    auto a = std::make_shared<arena::Bump_arena>(n * 32);
+    return Body{[a, n]{
+      size_t acc = 0;
+      for (size_t i = 0; i < n; ++i) acc += size_t(a->allocate(32)) & 1;
+      a->reset();
+      return acc;
+    }};
+  }, 1*MB});
+
+  // n tasks through the pool: a trivial parallel_for body per index, and
+  // n empty spawned tasks. Both measure scheduling, not work.
+  static job::Pool job_pool;
+  cases.push_back({"job::parallel_for", "calls", [](size_t n){
+    auto hits = std::make_shared<std::vector<uint8_t>>(n);
+    return Body{[hits]{
+      job::parallel_for(job_pool, 0, hits->size(), [&](size_t lo, size_t hi){
+	for (size_t i = lo; i < hi; ++i) (*hits)[i]++;
+      });
+      return hits->size();
+    }};
+  }, 16*MB});
+  cases.push_back({"job::Group spawn/wait", "calls", [](size_t n){
+    return Body{[n]{
+      std::atomic<size_t> done{0};
+      job::Group group(job_pool);
+      for (size_t i = 0; i < n; ++i) group.spawn([&done]{ done.fetch_add(1, std::memory_order_relaxed); });
+      group.wait();
+      return done.load();
+    }};
+  }, 1*MB});
+
+
+  cases.push_back({"fprint(\"{}\")", "bytes", [](size_t n){
+    auto s = std::make_shared<std::string>(make_text(n));
+    return Body{[s]{
+      static Null_buf buf;
+      static std::ostream null_stream(&buf);
+      fprint(null_stream, "{}", *s);
+      return s->size();
+    }};
+  }});
+
+  cases.push_back({"Arg::pop", "calls", [](size_t n){
+    auto storage = std::make_shared<std::vector<std::string>>();
+    auto argv = std::make_shared<std::vector<char*>>();
+    for (size_t i = 0; i < n; ++i) storage->push_back(FMT("--arg{}", i));
+    for (auto& a : *storage) argv->push_back(a.data());
+    return Body{[storage, argv]{
+      int c = int(argv->size());
+      char **v = argv->data();
+      Arg arg(c, v);
+      size_t acc = 0;
+      while (arg) acc += arg.pop().size();
+      return acc;
+    }};
+  }, 1*MB});
+
+  cases.push_back({"get_env", "calls", [](size_t n){
+    return Body{[n]{ size_t acc = 0; for (size_t i = 0; i < n; ++i) acc += get_env("PATH").size(); return acc; }};
+  }, 1*MB});
+
+  cases.push_back({"file::slurp_file (warm)", "bytes", [](size_t n){
+    auto path = std::make_shared<std::filesystem::path>(temp_file(n));
+    write_file(*path, make_text(n));
+    sink = sink + file::slurp_file(path->string()).size();
+    return Body{[path]{ return file::slurp_file(path->string()).size(); }};
+  }});
+
+#if defined(__linux__)
+  cases.push_back({"file::slurp_file (cold)", "bytes", [](size_t n){
+    auto path = std::make_shared<std::filesystem::path>(temp_file(n));
+    write_file(*path, make_text(n));
+    return Body{[path]{ return file::slurp_file(path->string()).size(); },
+		[path]{ drop_page_cache(*path); }};
+  }});
+#endif
+
+  // Appends a new key to a file holding n bytes of existing entries; the
+  // whole file is read and rewritten on every call.
+  cases.push_back({"file::save_data_to_file", "bytes", [](size_t n){
+    auto path = std::make_shared<std::filesystem::path>(temp_file(n));
+    std::string data;
+    for (size_t i = 0; data.size() < n; ++i) data += FMT("key{}: value\n", i);
+    write_file(*path, data);
+    auto key = std::make_shared<size_t>(0);
+    return Body{[path, key]{
+      file::save_data_to_file(FMT("new{}", (*key)++), "value", path->string());
+      return *key;
+    }};
+  }});
+
+  return cases;
+}
+
+// Runner ----------------------------------------
+static double elapsed_ns(std::chrono::steady_clock::time_point start){
+  return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+}
+
+static double time_call(const Body& body){
+  if (body.prepare) body.prepare();
+  auto start = std::chrono::steady_clock::now();
+  sink = sink + body.run();
+  return elapsed_ns(start);
+}
+
+static void compute_stats(Result& r, std::vector<double> samples){
+  std::sort(samples.begin(), samples.end());
+  r.reps = int(samples.size());
+  r.min = samples.front();
+  r.median = samples.size() % 2 ? samples[samples.size()/2]
+    : (samples[samples.size()/2 - 1] + samples[samples.size()/2]) / 2.0;
+  double sum = 0;
+  for (double s : samples) sum += s;
+  r.mean = sum / double(samples.size());
+  double var = 0;
+  for (double s : samples) var += (s - r.mean) * (s - r.mean);
+  r.stddev = std::sqrt(var / double(samples.size()));
+}
+
+static void run_case(const Case& c, const Config& cfg, std::vector<Result>& results){
+  const double budget_ns = cfg.budget_ms * 1e6;
+  Option<Result> prev;
+  std::string skip_reason;
+
+  for (size_t n : sizes){
+    if (n > cfg.max_size || n > c.max_n) continue;
+    Result r{c.name, c.unit, n};
+
+    if (skip_reason.empty() && prev){
+      // Small sizes understate the exponent of a quadratic helper, and one
+      // call at the next size can't be interrupted, so anything visibly
+      // superlinear is projected as at least quadratic.
+      double k = prev.unwrap().growth;
+      if (k > 1.25) k = std::max(k, 2.0);
+      else k = 1.0;
+      double projected = prev.unwrap().median * std::pow(double(n) / double(prev.unwrap().n), k);
+      if (projected > budget_ns) skip_reason = FMT("skipped: projected {:.1f} s per call", projected / 1e9);
+    }
+    if (!skip_reason.empty()){
+      r.note = skip_reason;
+      print("{:<34}{:>12}  {}\n", r.name, n, r.note);
+      results.push_back(r);
+      continue;
+    }
+
+    Body body = c.make(n);
+    double first = time_call(body);
+    std::vector<double> samples;
+    if (first > budget_ns){
+      samples.push_back(first);
+      r.iters = 1;
+      r.note = "over budget";
+      skip_reason = FMT("skipped: {:.1f} s per call at {} {}", first / 1e9, n, c.unit);
+    } else {
+      r.iters = body.prepare ? 1 : std::max<size_t>(1, size_t(cfg.min_sample_ms * 1e6 / std::max(first, 1.0)));
+      int reps = std::max(1, std::min(cfg.reps, int(budget_ns / std::max(first * double(r.iters), 1.0))));
+      for (int rep = 0; rep < reps; ++rep){
+	if (body.prepare){
+	  samples.push_back(time_call(body));
+	  continue;
+	}
+	auto start = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < r.iters; ++i) sink = sink + body.run();
+	samples.push_back(elapsed_ns(start) / double(r.iters));
+      }
+    }
+    compute_stats(r, samples);
+    if (prev && prev.unwrap().median > 0){
+      r.growth = std::log(r.median / prev.unwrap().median) / std::log(double(n) / double(prev.unwrap().n));
+    }
+
+    print("{:<34}{:>12}{:>14.0f}{:>14.0f}{:>14.0f}{:>12.0f}{:>8.2f}  {}\n",
+	  r.name, n, r.min, r.median, r.mean, r.stddev, r.growth, r.note);
+    results.push_back(r);
+    prev = r;
+  }
+}
+
+static bool pin_to_cpu(int cpu){
+#if defined(__linux__)
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  return sched_setaffinity(0, sizeof(set), &set) == 0;
+#elif defined(_WIN32)
+  return SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << cpu) != 0;
+#else
+  return false;
+#endif
+}
+
+static std::string json_escape(const std::string& s){
+  std::string res;
+  for (char c : s){
+    if (c == '"' || c == '\\') res += '\\';
+    res += c;
+  }
+  return res;
+}
+
+static void write_json(const Config& cfg, bool pinned, const std::vector<Result>& results){
+  std::ofstream ofs(cfg.json_path, std::ios::binary);
+  if (!ofs.is_open()){
+    fprint(std::cerr, "ERROR: Could not open `{}` for writing\n", cfg.json_path);
+    return;
+  }
+  fprint(ofs, "{{\n  \"reps\": {},\n  \"budget_ms\": {},\n  \"cpu\": {},\n  \"results\": [\n",
+	 cfg.reps, cfg.budget_ms, pinned ? cfg.cpu : -1);
+  for (size_t i = 0; i < results.size(); ++i){
+    const Result& r = results[i];
+    fprint(ofs, "    {{\"name\": \"{}\", \"unit\": \"{}\", \"n\": {}, \"iters\": {}, \"reps\": {}, "
+	   "\"min_ns\": {:.1f}, \"median_ns\": {:.1f}, \"mean_ns\": {:.1f}, \"stddev_ns\": {:.1f}, "
+	   "\"growth\": {:.3f}, \"note\": \"{}\"}}{}\n",
+	   json_escape(r.name), r.unit, r.n, r.iters, r.reps, r.min, r.median, r.mean, r.stddev,
+	   r.growth, json_escape(r.note), i + 1 < results.size() ? "," : "");
+  }
+  fprint(ofs, "  ]\n}}\n");
+}
+
+int main(int argc, char *argv[]) {
+  Config cfg;
+  ARG();
+  arg.pop();
+  while (arg){
+    std::string flag = arg.pop();
+    if (flag == "--reps") cfg.reps = std::max(1, std::stoi(arg.pop()));
+    else if (flag == "--budget-ms") cfg.budget_ms = std::stod(arg.pop());
+    else if (flag == "--cpu") cfg.cpu = std::stoi(arg.pop());
+    else if (flag == "--max-size") cfg.max_size = std::stoull(arg.pop());
+    else if (flag == "--filter") cfg.filter = arg.pop();
+    else if (flag == "--json") cfg.json_path = arg.pop();
+    else {
+      fprint(std::cerr, "ERROR: Unknown flag `{}`\n", flag);
+      return 1;
+    }
+  }
+
+  bool pinned = pin_to_cpu(cfg.cpu);
+  if (!pinned) fprint(std::cerr, "WARNING: Could not pin to cpu {}\n", cfg.cpu);
+
+  print("{:<34}{:>12}{:>14}{:>14}{:>14}{:>12}{:>8}\n", "case", "n", "min ns", "median ns", "mean ns", "stddev", "growth");
+  std::vector<Result> results;
+  for (const Case& c : make_cases()){
+    if (!cfg.filter.empty() && c.name.find(cfg.filter) == std::string::npos) continue;
+    run_case(c, cfg, results);
+  }
+
+  for (size_t n : sizes){
+    std::error_code ec;
+    std::filesystem::remove(temp_file(n), ec);
+  }
+
+  write_json(cfg, pinned, results);
+  print("wrote {} results to {}\n", results.size(), cfg.json_path);
+  return 0;
+}
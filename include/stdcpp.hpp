@@ -9,6 +9,21 @@
 #include <vector>
 #include <functional>
 #include <fstream>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <cstdint>
+#include <atomic>
+#include <bit>
+#include <cmath>
+#include <limits>
+#include <memory_resource>
+#include <cstddef>
+#include <cstring>
+#include <thread>
+#include <mutex>
+#include <deque>
+#include <exception>
 
 #if defined USE_WIN32
 #define WIN32_MEAN_AND_LEAN
@@ -93,37 +108,164 @@ struct Arg {
 
 // Option --------------------------------------------------
 
+// Union storage: an empty Option never constructs a T, values are moved in
+// and out, and Option<T> is trivially copyable/destructible whenever T is.
 template <typename T>
 struct Option{
-  T value;
+  union { T value; };
   bool _has_value{false};
 
   Option(){ }
 
-  Option(T _value){
-    value = _value;
-    _has_value = true;
+  Option(const T& _value) : value(_value), _has_value(true) { }
+  Option(T&& _value) : value(std::move(_value)), _has_value(true) { }
+
+  Option(const Option&) requires std::is_trivially_copy_constructible_v<T> = default;
+  Option(const Option& other) requires (!std::is_trivially_copy_constructible_v<T>) {
+    if (other._has_value) emplace(other.value);
+  }
+
+  Option(Option&&) requires std::is_trivially_move_constructible_v<T> = default;
+  Option(Option&& other) noexcept(std::is_nothrow_move_constructible_v<T>)
+    requires (!std::is_trivially_move_constructible_v<T>) {
+    if (other._has_value) emplace(std::move(other.value));
+  }
+
+  Option& operator=(const Option&) requires std::is_trivially_copyable_v<T> = default;
+  Option& operator=(const Option& other) requires (!std::is_trivially_copyable_v<T>) {
+    if (other._has_value) *this = other.value;
+    else reset();
+    return *this;
   }
 
-  operator bool() { return has_value(); }
+  Option& operator=(Option&&) requires std::is_trivially_copyable_v<T> = default;
+  Option& operator=(Option&& other) noexcept(std::is_nothrow_move_assignable_v<T> && std::is_nothrow_move_constructible_v<T>)
+    requires (!std::is_trivially_copyable_v<T>) {
+    if (other._has_value) *this = std::move(other.value);
+    else reset();
+    return *this;
+  }
+
+  ~Option() requires std::is_trivially_destructible_v<T> = default;
+  ~Option() requires (!std::is_trivially_destructible_v<T>) { reset(); }
+
+  operator bool() const { return has_value(); }
   bool has_value() const { return _has_value; }
-  bool operator!() { return !has_value(); }
+  bool operator!() const { return !has_value(); }
 
+  Option& operator=(const T& _v){
+    if (_has_value) value = _v;
+    else emplace(_v);
+    return *this;
+  }
+
+  Option& operator=(T&& _v){
+    if (_has_value) value = std::move(_v);
+    else emplace(std::move(_v));
+    return *this;
+  }
 
-  T operator=(const T& _v){
-    value = _v;
+  template <typename... Args>
+  T& emplace(Args&&... args){
+    reset();
+    std::construct_at(&value, std::forward<Args>(args)...);
     _has_value = true;
     return value;
   }
-			   
-  T operator=(T& _v){
-     value = _v;
-    _has_value = true;
+
+  void reset(){
+    if constexpr (!std::is_trivially_destructible_v<T>){
+      if (_has_value) value.~T();
+    }
+    _has_value = false;
+  }
+
+  T& unwrap() & {
+#ifdef DEBUG
+    ASSERT(_has_value);
+#endif
     return value;
   }
+  const T& unwrap() const & {
+#ifdef DEBUG
+    ASSERT(_has_value);
+#endif
+    return value;
+  }
+  T&& unwrap() && {
+#ifdef DEBUG
+    ASSERT(_has_value);
+#endif
+    return std::move(value);
+  }
+
+  // f(T) -> U, gives Option<U>
+  template <typename F>
+  auto map(F&& f) & -> Option<std::invoke_result_t<F, T&>> {
+    if (_has_value) return std::invoke(std::forward<F>(f), value);
+    return {};
+  }
+  template <typename F>
+  auto map(F&& f) && -> Option<std::invoke_result_t<F, T&&>> {
+    if (_has_value) return std::invoke(std::forward<F>(f), std::move(value));
+    return {};
+  }
+
+  // f(T) -> Option<U>, gives Option<U>
+  template <typename F>
+  auto and_then(F&& f) & -> std::invoke_result_t<F, T&> {
+    if (_has_value) return std::invoke(std::forward<F>(f), value);
+    return {};
+  }
+  template <typename F>
+  auto and_then(F&& f) && -> std::invoke_result_t<F, T&&> {
+    if (_has_value) return std::invoke(std::forward<F>(f), std::move(value));
+    return {};
+  }
+};
+
+// Option<T&> is a nullable reference: one pointer, always trivially copyable.
+template <typename T>
+struct Option<T&>{
+  T* value{nullptr};
+
+  Option(){ }
+  Option(T& _value) : value(&_value) { }
+
+  operator bool() const { return has_value(); }
+  bool has_value() const { return value != nullptr; }
+  bool operator!() const { return !has_value(); }
+
+  Option& operator=(T& _v){
+    value = &_v;
+    return *this;
+  }
+
+  T& emplace(T& _v){
+    value = &_v;
+    return *value;
+  }
+
+  void reset(){ value = nullptr; }
+
+  T& unwrap() const {
+#ifdef DEBUG
+    ASSERT(value != nullptr);
+#endif
+    return *value;
+  }
 
-  T& unwrap() { return value; }
+  template <typename F>
+  auto map(F&& f) const -> Option<std::invoke_result_t<F, T&>> {
+    if (value) return std::invoke(std::forward<F>(f), *value);
+    return {};
+  }
 
+  template <typename F>
+  auto and_then(F&& f) const -> std::invoke_result_t<F, T&> {
+    if (value) return std::invoke(std::forward<F>(f), *value);
+    return {};
+  }
 };
 
 
@@ -177,10 +319,126 @@ namespace sv {
 
 } // namespace sv
 
+// random --------------------------------------------------
+// Generators for math::randomf/randomi/chance. Each thread owns its default
+// generator (math::rng()), so there is no shared state to contend on; seed()
+// makes a thread's sequence reproducible. Both generators satisfy
+// UniformRandomBitGenerator and can be handed to <random> distributions.
+namespace math {
+  uint64_t splitmix64(uint64_t& state);
+
+  // xoshiro256** by Blackman and Vigna: 256 bits of state, period 2^256-1.
+  struct Xoshiro256{
+    typedef uint64_t result_type;
+    uint64_t s[4];
+
+    explicit Xoshiro256(uint64_t seed=0x9E3779B97F4A7C15ull) { reseed(seed); }
+
+    void reseed(uint64_t seed){
+      for (uint64_t& w : s) w = splitmix64(seed);
+    }
+
+    static uint64_t rotl(uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
+
+    uint64_t next(){
+      const uint64_t result = rotl(s[1] * 5, 7) * 9;
+      const uint64_t t = s[1] << 17;
+      s[2] ^= s[0];
+      s[3] ^= s[1];
+      s[1] ^= s[2];
+      s[0] ^= s[3];
+      s[2] ^= t;
+      s[3] = rotl(s[3], 45);
+      return result;
+    }
+
+    // Advances by 2^128 calls to next(), to split one seed into
+    // non-overlapping streams.
+    void jump();
+    // Advances by 2^192 calls to next(): 2^64 streams, each with room for
+    // 2^64 jump()s of its own.
+    void long_jump();
+
+    static constexpr result_type min() { return 0; }
+    static constexpr result_type max() { return ~result_type(0); }
+    result_type operator()() { return next(); }
+  };
+
+  // PCG32 (XSH RR) by O'Neill: 64 bits of state, selectable stream.
+  struct Pcg32{
+    typedef uint32_t result_type;
+    uint64_t state{0};
+    uint64_t inc{1};
+
+    explicit Pcg32(uint64_t seed=0x853C49E6748FEA9Bull, uint64_t stream=0xDA3E39CB94B95BDBull) { reseed(seed, stream); }
+
+    void reseed(uint64_t seed, uint64_t stream=0xDA3E39CB94B95BDBull){
+      state = 0;
+      inc = (stream << 1) | 1;
+      next();
+      state += seed;
+      next();
+    }
+
+    uint32_t next(){
+      uint64_t old = state;
+      state = old * 6364136223846793005ull + inc;
+      uint32_t xorshifted = uint32_t(((old >> 18) ^ old) >> 27);
+      uint32_t rot = uint32_t(old >> 59);
+      return (xorshifted >> rot) | (xorshifted << ((32 - rot) & 31));
+    }
+
+    static constexpr result_type min() { return 0; }
+    static constexpr result_type max() { return ~result_type(0); }
+    result_type operator()() { return next(); }
+  };
+
+  // The calling thread's default generator. Threads start on distinct
+  // streams derived from one fixed seed, so runs are reproducible.
+  Xoshiro256& rng();
+  // Reseeds the calling thread's default generator and its fill_uniform lanes.
+  void seed(uint64_t seed);
+
+  template <typename Gen>
+  uint32_t next_u32(Gen& gen){
+    if constexpr (sizeof(typename Gen::result_type) > 4) return uint32_t(gen.next() >> 32);
+    else return gen.next();
+  }
+
+  // Uniform in [0, range) without modulo bias (Lemire's multiply-shift with
+  // rejection); the division only runs on the rare rejected draws.
+  template <typename Gen>
+  uint32_t bounded(Gen& gen, uint32_t range){
+    uint64_t m = uint64_t(next_u32(gen)) * range;
+    uint32_t low = uint32_t(m);
+    if (low < range){
+      uint32_t threshold = uint32_t(-range) % range;
+      while (low < threshold){
+	m = uint64_t(next_u32(gen)) * range;
+	low = uint32_t(m);
+      }
+    }
+    return uint32_t(m >> 32);
+  }
+
+  // Uniform in [min, max), from the top 24 bits of a draw.
+  template <typename Gen>
+  float uniformf(Gen& gen, float min, float max){
+    return min + (float(next_u32(gen) >> 8) * 0x1.0p-24f) * (max - min);
+  }
+
+  // Fills out[0..n) with floats uniform in [min, max). Uses four
+  // xoshiro256** lanes per thread, stepped with AVX2 when the CPU has it
+  // and one lane at a time otherwise; both paths draw the same integers.
+  void fill_uniform(float* out, size_t n, float min, float max);
+  bool has_avx2();
+} // namespace math
+
 // math --------------------------------------------------
 namespace math {
 #define PI 3.14159265359
 
+  // randomf: [min, max); randomi: [min, max), unbiased; chance: percent in [0, 100].
   float randomf(const float min, const float max);
   int randomi(const int min, const int max);
   float rad2deg(const float rad);
@@ -193,6 +451,367 @@ namespace math {
 			  const float x2, const float y2, const float w2, const float h2);
 } // namespace math
 
+// rect batch --------------------------------------------------
+// Many rects against many rects. Rect_batch stores them as separate x/y/w/h
+// arrays padded with NaN to a multiple of 8, so the AVX2 kernels always load
+// whole registers and the padding never matches. Edges are inclusive, the
+// same as rect_intersects_rect/rect_contains_rect.
+namespace math {
+  struct Rect{
+    float x{0}, y{0}, w{0}, h{0};
+  };
+
+  struct Rect_batch{
+    std::vector<float> x, y, w, h;
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    void reserve(size_t n);
+    void clear();
+    uint32_t push(const Rect& r);
+    Rect get(size_t i) const { return {x[i], y[i], w[i], h[i]}; }
+
+  private:
+    size_t count{0};
+  };
+
+  // One bit per rect of `batch` (bit i%64 of word i/64); returns the number of hits.
+  size_t intersects_mask(const Rect& r, const Rect_batch& batch, std::vector<uint64_t>& mask);
+  // Bits set for the rects of `batch` that lie inside `outer`.
+  size_t contains_mask(const Rect& outer, const Rect_batch& batch, std::vector<uint64_t>& mask);
+  // Same queries, appending the matching indices to `out`.
+  size_t intersects_indices(const Rect& r, const Rect_batch& batch, std::vector<uint32_t>& out);
+  size_t contains_indices(const Rect& outer, const Rect_batch& batch, std::vector<uint32_t>& out);
+  // Every intersecting pair (i < j) within `batch`: O(N^2), eight at a time.
+  size_t intersecting_pairs(const Rect_batch& batch, std::vector<std::pair<uint32_t, uint32_t>>& out);
+
+  // Uniform-grid broadphase over a Rect_batch. Each rect is listed in every
+  // cell it overlaps, so queries only test rects sharing a cell with the
+  // query rect. Rebuild after the batch changes.
+  struct Rect_grid{
+    // cell_size <= 0 picks one from the mean rect extent.
+    void build(const Rect_batch& batch, float cell_size=0.f);
+    size_t query(const Rect& r, const Rect_batch& batch, std::vector<uint32_t>& out);
+    size_t pairs(const Rect_batch& batch, std::vector<std::pair<uint32_t, uint32_t>>& out) const;
+
+    float cell{1.f};
+    float origin_x{0}, origin_y{0};
+    int cols{0}, rows{0};
+    std::vector<uint32_t> cell_start; // cols*rows+1 offsets into entries
+    std::vector<uint32_t> entries;
+
+  private:
+    int col_of(float x) const;
+    int row_of(float y) const;
+    std::vector<uint32_t> stamp;      // per rect: last query that reported it
+    uint32_t query_id{0};
+  };
+} // namespace math
+
+// arena --------------------------------------------------
+// Allocators for data that dies together, all std::pmr::memory_resources so
+// pmr containers and strings can live in them. mark() and reset(mark) drop
+// everything allocated after the mark at once; Arena_scope does that when
+// it goes out of scope. With STDCPP_ARENA_POISON (on in DEBUG builds) fresh
+// memory is filled with 0xCD and released memory with 0xDD, so reads of
+// uninitialized or dead arena memory stand out.
+#ifndef STDCPP_ARENA_POISON
+#ifdef DEBUG
+#define STDCPP_ARENA_POISON 1
+#else
+#define STDCPP_ARENA_POISON 0
+#endif
+#endif
+
+namespace arena {
+  // Monotonic bump allocation from one fixed buffer, either the caller's or
+  // one taken from `upstream`. Throws std::bad_alloc when it is full.
+  struct Bump_arena : std::pmr::memory_resource {
+    typedef size_t Mark;
+
+    explicit Bump_arena(size_t capacity, std::pmr::memory_resource* upstream=std::pmr::get_default_resource());
+    Bump_arena(void* buffer, size_t capacity);
+    ~Bump_arena();
+    Bump_arena(const Bump_arena&) = delete;
+    Bump_arena& operator=(const Bump_arena&) = delete;
+
+    Mark mark() const { return used; }
+    void reset(Mark m=0);
+    size_t size() const { return used; }
+    size_t capacity() const { return cap; }
+
+  private:
+    void* do_allocate(size_t bytes, size_t align) override;
+    void do_deallocate(void*, size_t, size_t) override { }
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+
+    char* base{nullptr};
+    size_t cap{0};
+    size_t used{0};
+    std::pmr::memory_resource* upstream{nullptr}; // set when the arena owns `base`
+  };
+
+  // A block of memory taken from an upstream resource; the payload follows
+  // the header.
+  struct Chunk {
+    Chunk* next;
+    size_t size;  // payload bytes
+    size_t used;  // Chunked_arena: payload bytes handed out
+  };
+
+  // Bump allocation from a list of chunks that double in size, starting at
+  // `first_chunk` bytes. A reset keeps the chunks for reuse, so an arena
+  // that is reset once per iteration stops calling `upstream` when warm.
+  struct Chunked_arena : std::pmr::memory_resource {
+    struct Mark {
+      Chunk* chunk{nullptr};
+      size_t used{0};
+      size_t total{0};
+    };
+
+    explicit Chunked_arena(size_t first_chunk=64*1024, std::pmr::memory_resource* upstream=std::pmr::get_default_resource());
+    ~Chunked_arena();
+    Chunked_arena(const Chunked_arena&) = delete;
+    Chunked_arena& operator=(const Chunked_arena&) = delete;
+
+    Mark mark() const { return {current, current ? current->used : 0, total}; }
+    void reset(Mark m);
+    void reset(){ reset(Mark{}); }
+    // Returns every chunk to `upstream`.
+    void release();
+    size_t size() const { return total; }
+    size_t reserved() const { return held; }
+
+  private:
+    void* do_allocate(size_t bytes, size_t align) override;
+    void do_deallocate(void*, size_t, size_t) override { }
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+
+    Chunk* first{nullptr};
+    Chunk* current{nullptr};
+    size_t next_size;
+    size_t total{0}; // bytes handed out since the last reset, padding included
+    size_t held{0};  // payload bytes of all chunks
+    std::pmr::memory_resource* upstream;
+  };
+
+  // Fixed-size blocks on a free list, carved from chunks that double in
+  // size. Requests larger or more aligned than a block go to `upstream`.
+  struct Pool : std::pmr::memory_resource {
+    explicit Pool(size_t block_size, size_t block_align=alignof(std::max_align_t),
+		  std::pmr::memory_resource* upstream=std::pmr::get_default_resource());
+    ~Pool();
+    Pool(const Pool&) = delete;
+    Pool& operator=(const Pool&) = delete;
+
+    size_t block_size() const { return block; }
+    size_t live() const { return live_blocks; }
+    // Frees every block at once; the chunks are kept.
+    void reset();
+    // Returns every chunk to `upstream`.
+    void release();
+
+  private:
+    struct Free {
+      Free* next;
+    };
+
+    void* do_allocate(size_t bytes, size_t align) override;
+    void do_deallocate(void* p, size_t bytes, size_t align) override;
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+
+    size_t block;
+    size_t align;
+    size_t next_blocks{64};
+    size_t live_blocks{0};
+    Free* free_list{nullptr};
+    Chunk* first{nullptr};
+    Chunk* last{nullptr};
+    Chunk* carving{nullptr}; // blocks are carved from here up to `carve_end`
+    char* carve_cur{nullptr};
+    char* carve_end{nullptr};
+    std::pmr::memory_resource* upstream;
+  };
+
+  // Resets `arena` to where it was at construction when the scope ends.
+  template <typename Arena>
+  struct Arena_scope {
+    explicit Arena_scope(Arena& _arena) : arena(_arena), m(_arena.mark()) { }
+    ~Arena_scope(){ arena.reset(m); }
+    Arena_scope(const Arena_scope&) = delete;
+    Arena_scope& operator=(const Arena_scope&) = delete;
+
+  private:
+    Arena& arena;
+    typename Arena::Mark m;
+  };
+} // namespace arena
+
+// job --------------------------------------------------
+// A work-stealing scheduler. Every worker thread owns a Chase-Lev deque
+// (Chase and Lev, "Dynamic circular work-stealing deque", with the memory
+// orders of Le et al., "Correct and efficient work-stealing for weak memory
+// models"): it pushes and pops its own tasks at the bottom, and a worker
+// that runs dry steals from the top of another's. Threads that are not
+// workers submit through one locked queue. A thread waiting on a Group runs
+// tasks instead of blocking, so groups nest and the waiting thread counts
+// as one more worker. Idle workers sleep until a task is submitted.
+namespace job {
+  struct Group;
+
+  struct Task {
+    Group* group{nullptr};
+    virtual ~Task() = default;
+    virtual void run() = 0;
+  };
+
+  // One owner push()es and pop()s at the bottom; any thread may steal()
+  // from the top. Grows by doubling; replaced rings are kept until the
+  // deque dies, since a thief may still be reading one.
+  struct Deque {
+    explicit Deque(size_t capacity=256);
+    ~Deque();
+    Deque(const Deque&) = delete;
+    Deque& operator=(const Deque&) = delete;
+
+    void push(Task* task);
+    Task* pop();
+    Task* steal();
+    bool empty() const { return bottom.load(std::memory_order_relaxed) <= top.load(std::memory_order_relaxed); }
+
+  private:
+    struct Ring {
+      int64_t mask;
+      std::unique_ptr<std::atomic<Task*>[]> slots;
+
+      explicit Ring(int64_t capacity) : mask(capacity - 1), slots(new std::atomic<Task*>[size_t(capacity)]) { }
+      Task* get(int64_t i) const { return slots[size_t(i & mask)].load(std::memory_order_relaxed); }
+      void put(int64_t i, Task* task){ slots[size_t(i & mask)].store(task, std::memory_order_relaxed); }
+    };
+
+    alignas(64) std::atomic<int64_t> top{0};
+    alignas(64) std::atomic<int64_t> bottom{0};
+    std::atomic<Ring*> ring;
+    std::vector<Ring*> rings; // every ring, the current one last
+  };
+
+  struct Pool {
+    // Starts `workers` threads, by default one less than the hardware has.
+    // With `pin`, worker i is bound to CPU i + 1 where the OS allows it.
+    explicit Pool(int workers=-1, bool pin=false);
+    // Runs what is still queued, then stops and joins the workers.
+    ~Pool();
+    Pool(const Pool&) = delete;
+    Pool& operator=(const Pool&) = delete;
+
+    // Threads that run tasks while one thread waits on a Group.
+    int size() const { return int(threads.size()) + 1; }
+    // Queues `task` on the calling worker's deque, or on the shared queue
+    // when called from elsewhere.
+    void submit(Task* task);
+    // Whether the caller has no queued task that others could steal.
+    bool local_empty() const;
+    // Runs one queued task, if there is one, on the calling thread.
+    bool run_one();
+
+  private:
+    friend struct Group;
+
+    Task* find_task();
+    void execute(Task* task);
+    void worker_loop(int index);
+    // Sleeps until a task is submitted, unless there is one to run or the
+    // wait is over: `pending` reached 0, or the pool is stopping.
+    void idle(const std::atomic<size_t>* pending);
+    void wake_one();
+    void wake_all();
+
+    std::vector<std::thread> threads;
+    std::vector<std::unique_ptr<Deque>> deques; // one per worker
+    std::mutex injected_lock;
+    std::deque<Task*> injected; // submitted by other threads, run oldest first
+    std::atomic<size_t> injected_count{0};
+    std::atomic<uint32_t> epoch{0};   // bumped to wake sleepers
+    std::atomic<int> sleepers{0};
+    std::atomic<bool> stopping{false};
+  };
+
+  // Tasks that are waited for together.
+  struct Group {
+    explicit Group(Pool& _pool) : pool(_pool) { }
+    // Waits, dropping any exception.
+    ~Group();
+    Group(const Group&) = delete;
+    Group& operator=(const Group&) = delete;
+
+    template <typename F>
+    void spawn(F&& fn);
+    // Runs tasks until every task spawned in the group has finished, then
+    // rethrows the first exception a task threw.
+    void wait();
+
+  private:
+    friend struct Pool;
+
+    void drain();
+    void finish(std::exception_ptr error);
+
+    Pool& pool;
+    std::atomic<size_t> pending{0};
+    std::mutex error_lock;
+    std::exception_ptr error;
+  };
+
+  template <typename F>
+  struct Fn_task : Task {
+    F fn;
+
+    template <typename G>
+    explicit Fn_task(G&& _fn) : fn(std::forward<G>(_fn)) { }
+    void run() override { fn(); }
+  };
+
+  template <typename F>
+  void Group::spawn(F&& fn){
+    Task* task = new Fn_task<std::decay_t<F>>(std::forward<F>(fn));
+    task->group = this;
+    pending.fetch_add(1, std::memory_order_relaxed);
+    pool.submit(task);
+  }
+
+  // Calls body(lo, hi) over subranges that cover [begin, end) exactly once.
+  // The range is split lazily (Tzannes et al., "Lazy binary splitting"): a
+  // task runs its range `grain` indices at a time and splits off the upper
+  // half of what is left only when the thread has no queued work of its
+  // own, so the number of tasks follows the number of idle threads rather
+  // than the size of the range. With `grain` 0 it is picked from the size.
+  template <typename F>
+  void parallel_for(Pool& pool, size_t begin, size_t end, F&& body, size_t grain=0){
+    if (begin >= end) return;
+    if (pool.size() == 1){
+      body(begin, end);
+      return;
+    }
+    if (grain == 0) grain = std::max<size_t>(1, (end - begin) / (size_t(pool.size()) * 64));
+
+    Group group(pool);
+    auto run = [&](auto& self, size_t lo, size_t hi) -> void {
+      while (lo < hi){
+	if (hi - lo > grain && pool.local_empty()){
+	  size_t mid = lo + (hi - lo) / 2;
+	  group.spawn([&self, mid, hi](){ self(self, mid, hi); });
+	  hi = mid;
+	}
+	size_t stop = std::min(hi, lo + grain);
+	body(lo, stop);
+	lo = stop;
+      }
+    };
+    run(run, begin, end);
+    group.wait();
+  }
+} // namespace job
+
 namespace file {
   std::string slurp_file(const std::string& filename);
 
@@ -373,13 +992,18 @@ std::string Arg::pop() {
 
   std::string arg = *argv[0];
 
+  if (arg.empty()){
+    *argc = *argc - 1;
+    *argv = *argv + 1;
+    return arg;
+  }
   if (arg[0] == '\''){
     evaluating_quote = true;
-    str::lremove(arg);
+    arg = str::lremove(arg);
   }
   if (arg.back() == '\''){
     evaluating_quote = false;
-    str::rremove(arg);
+    arg = str::rremove(arg);
   }
 
   *argc = *argc - 1;
@@ -471,15 +1095,15 @@ namespace str {
   }
 
   std::string lremove_until(std::string str, std::function<bool(const char&)> predecate){
-    while (predecate(str[0]) && !str.empty()){
-      lremove(str);
+    while (!str.empty() && predecate(str[0])){
+      str = lremove(str);
     }
     return str;
   }
 
   std::string rremove_until(std::string str, std::function<bool(const char&)> predecate){
-    while (predecate(str[str.size()-1]) && !str.empty()){
-      rremove(str);
+    while (!str.empty() && predecate(str[str.size()-1])){
+      str = rremove(str);
     }
     return str;
   }
@@ -528,7 +1152,7 @@ namespace str {
     while (thing_pos != std::string::npos){
       std::string before_thing{str.substr(0, thing_pos)};
       std::string after_thing{str.substr(thing_pos)};
-      str::lremove(after_thing, thing.size());
+      after_thing = str::lremove(after_thing, thing.size());
       str = before_thing + with + after_thing;
       thing_pos = str.find(thing, before_thing.size() + with.size());
     }
@@ -575,12 +1199,12 @@ namespace str {
   }
 
   std::string rpop_until(std::string str, std::function<bool(const char&)> predacate){
-    size_t i = str.size()-1;
-    while (i >= 0){
-      if (!predacate(str[i])){
+    size_t i = str.size();
+    while (i > 0){
+      if (!predacate(str[i-1])){
 	i--;
       } else {
-	return str.substr(i+1);
+	return str.substr(i);
       }
     }
     return str;
@@ -622,14 +1246,14 @@ std::string_view& rremove(std::string_view& sv, size_t size){
 }
 
 std::string_view& lremove_until(std::string_view& sv, std::function<bool(const char&)> predecate){
-  while (predecate(sv[0])){
+  while (!sv.empty() && predecate(sv[0])){
     sv::lremove(sv);
   }
   return sv;
 }
   
 std::string_view& rremove_until(std::string_view& sv, std::function<bool(const char&)> predecate){
-  while (predecate(sv[sv.size()-1])){
+  while (!sv.empty() && predecate(sv[sv.size()-1])){
     sv::rremove(sv);
   }
   return sv;  
@@ -654,7 +1278,7 @@ std::string_view& rremove_until(std::string_view& sv, const std::string_view& ch
   std::string_view s{};
   size_t s_i{sv.size()};
 
-  while (s_i - checker.size() >= 0){
+  while (s_i >= checker.size()){
     s = sv.substr(s_i - checker.size(), checker.size());
     if (s == checker) break;
     s_i--;
@@ -666,15 +1290,192 @@ std::string_view& rremove_until(std::string_view& sv, const std::string_view& ch
 
 } // namespace sv
 
+// random -------------------------
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define STDCPP_X86
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define STDCPP_TARGET_AVX2
+#else
+#define STDCPP_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+namespace math {
+
+uint64_t splitmix64(uint64_t& state){
+  uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+  return z ^ (z >> 31);
+}
+
+// Advances `g` by the jump polynomial `poly`.
+static void xoshiro_jump(Xoshiro256& g, const uint64_t (&poly)[4]){
+  uint64_t t[4]{0, 0, 0, 0};
+  for (uint64_t j : poly){
+    for (int b = 0; b < 64; ++b){
+      if (j & (uint64_t(1) << b)){
+	for (int i = 0; i < 4; ++i) t[i] ^= g.s[i];
+      }
+      g.next();
+    }
+  }
+  for (int i = 0; i < 4; ++i) g.s[i] = t[i];
+}
+
+void Xoshiro256::jump(){
+  static const uint64_t JUMP[] = {0x180EC6D33CFD0ABAull, 0xD5A61266F0C9392Cull, 0xA9582618E03FC9AAull, 0x39ABDC4529B1661Cull};
+  xoshiro_jump(*this, JUMP);
+}
+
+void Xoshiro256::long_jump(){
+  static const uint64_t LONG_JUMP[] = {0x76E15D3EFEFDCBBFull, 0xC5004E441C522FB3ull, 0x77710069854EE241ull, 0x39109BB02ACBE635ull};
+  xoshiro_jump(*this, LONG_JUMP);
+}
+
+// Four xoshiro256** generators side by side: s[word][lane], so each word is
+// one 256-bit register on the AVX2 path. The lanes are their thread's
+// generator jump()ed 1 to 4 times, which stays inside the thread's own
+// long_jump() stream.
+struct Xoshiro256x4{
+  alignas(32) uint64_t s[4][4];
+  bool seeded{false};
+
+  void reseed(Xoshiro256 from){
+    for (int lane = 0; lane < 4; ++lane){
+      from.jump();
+      for (int w = 0; w < 4; ++w) s[w][lane] = from.s[w];
+    }
+    seeded = true;
+  }
+};
+
+static std::atomic<uint64_t> next_thread_stream{0};
+
+// Thread k starts k long_jump()s into the default sequence, so no thread's
+// generator or lanes overlap another's.
+static Xoshiro256 thread_default(){
+  Xoshiro256 res;
+  uint64_t stream = next_thread_stream.fetch_add(1, std::memory_order_relaxed);
+  for (uint64_t i = 0; i < stream; ++i) res.long_jump();
+  return res;
+}
+
+static thread_local Xoshiro256 thread_rng = thread_default();
+static thread_local Xoshiro256x4 thread_lanes;
+
+Xoshiro256& rng() { return thread_rng; }
+
+void seed(uint64_t seed){
+  thread_rng.reseed(seed);
+  thread_lanes.reseed(thread_rng);
+}
+
+bool has_avx2(){
+#if defined(STDCPP_X86) && defined(_MSC_VER)
+  int info[4];
+  __cpuid(info, 1);
+  bool osxsave = (info[2] & (1 << 27)) != 0;
+  if (!osxsave || (_xgetbv(0) & 0x6) != 0x6) return false;
+  __cpuidex(info, 7, 0);
+  return (info[1] & (1 << 5)) != 0;
+#elif defined(STDCPP_X86)
+  return __builtin_cpu_supports("avx2");
+#else
+  return false;
+#endif
+}
+
+static void fill_uniform_scalar(Xoshiro256x4& lanes, float* out, size_t n, float min, float scale){
+  // Steps all four lanes at a time, even for a short tail, so the lane state
+  // matches the AVX2 path afterwards.
+  for (size_t i = 0; i < n; i += 8){
+    float step[8];
+    for (int lane = 0; lane < 4; ++lane){
+      Xoshiro256 g;
+      for (int w = 0; w < 4; ++w) g.s[w] = lanes.s[w][lane];
+      uint64_t x = g.next();
+      for (int w = 0; w < 4; ++w) lanes.s[w][lane] = g.s[w];
+      step[2*lane]   = min + (float(uint32_t(x) >> 8) * 0x1.0p-24f) * scale;
+      step[2*lane+1] = min + (float(uint32_t(x >> 32) >> 8) * 0x1.0p-24f) * scale;
+    }
+    for (size_t j = 0; j < 8 && i + j < n; ++j) out[i + j] = step[j];
+  }
+}
+
+#if defined(STDCPP_X86)
+STDCPP_TARGET_AVX2 static __m256i rotl_x4(__m256i x, int k){
+  return _mm256_or_si256(_mm256_slli_epi64(x, k), _mm256_srli_epi64(x, 64 - k));
+}
+
+// One step of all four lanes: four 64-bit draws, read as eight 32-bit
+// halves in the same order the scalar path uses.
+STDCPP_TARGET_AVX2 static inline __m256 step_x4(__m256i& s0, __m256i& s1, __m256i& s2, __m256i& s3,
+						__m256 vmin, __m256 vscale){
+  __m256i x5 = _mm256_add_epi64(s1, _mm256_slli_epi64(s1, 2));
+  __m256i r = rotl_x4(x5, 7);
+  __m256i result = _mm256_add_epi64(r, _mm256_slli_epi64(r, 3));
+  __m256i t = _mm256_slli_epi64(s1, 17);
+  s2 = _mm256_xor_si256(s2, s0);
+  s3 = _mm256_xor_si256(s3, s1);
+  s1 = _mm256_xor_si256(s1, s2);
+  s0 = _mm256_xor_si256(s0, s3);
+  s2 = _mm256_xor_si256(s2, t);
+  s3 = rotl_x4(s3, 45);
+  __m256 f = _mm256_cvtepi32_ps(_mm256_srli_epi32(result, 8));
+  return _mm256_add_ps(vmin, _mm256_mul_ps(f, vscale));
+}
+
+STDCPP_TARGET_AVX2 static void fill_uniform_avx2(Xoshiro256x4& lanes, float* out, size_t n, float min, float scale){
+  __m256i s0 = _mm256_load_si256((const __m256i*)lanes.s[0]);
+  __m256i s1 = _mm256_load_si256((const __m256i*)lanes.s[1]);
+  __m256i s2 = _mm256_load_si256((const __m256i*)lanes.s[2]);
+  __m256i s3 = _mm256_load_si256((const __m256i*)lanes.s[3]);
+  const __m256 vmin = _mm256_set1_ps(min);
+  const __m256 vscale = _mm256_set1_ps(scale * 0x1.0p-24f);
+
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) _mm256_storeu_ps(out + i, step_x4(s0, s1, s2, s3, vmin, vscale));
+  if (i < n){
+    alignas(32) float tail[8];
+    _mm256_store_ps(tail, step_x4(s0, s1, s2, s3, vmin, vscale));
+    for (size_t j = 0; i < n; ++i, ++j) out[i] = tail[j];
+  }
+
+  _mm256_store_si256((__m256i*)lanes.s[0], s0);
+  _mm256_store_si256((__m256i*)lanes.s[1], s1);
+  _mm256_store_si256((__m256i*)lanes.s[2], s2);
+  _mm256_store_si256((__m256i*)lanes.s[3], s3);
+}
+#endif
+
+void fill_uniform(float* out, size_t n, float min, float max){
+  Xoshiro256x4& lanes = thread_lanes;
+  if (!lanes.seeded) lanes.reseed(thread_rng);
+#if defined(STDCPP_X86)
+  static const bool avx2 = has_avx2();
+  if (avx2){
+    fill_uniform_avx2(lanes, out, n, min, max - min);
+    return;
+  }
+#endif
+  fill_uniform_scalar(lanes, out, n, min, max - min);
+}
+
+} // namespace math
+
 // math -------------------------
 namespace math {
 
 float randomf(const float min, const float max) {
-  return (float(rand()) / float(RAND_MAX) * (max - min)) + min;
+  return uniformf(rng(), min, max);
 }
   
 int randomi(const int min, const int max) {
-  return int((float(rand()) / float(RAND_MAX) * (max - min)) + min);
+  if (max <= min) return min;
+  return int(int64_t(min) + bounded(rng(), uint32_t(int64_t(max) - int64_t(min))));
 }
 
 float rad2deg(const float rad) { return float((rad / PI) * 180.f); }
@@ -691,7 +1492,7 @@ bool chance(float percent) {
   ASSERT_MSG(0.f <= percent && percent <= 100.f,
              "percent should be between 0.f and 100.f");
 
-  return math::randomf(0.f, 100.f) <= percent;
+  return math::randomf(0.f, 100.f) < percent;
 }
 
 bool rect_intersects_rect(const float x1, const float y1, const float w1, const float h1,
@@ -701,7 +1502,7 @@ bool rect_intersects_rect(const float x1, const float y1, const float w1, const
   float r1_top =  y1;
   float r2_left = x2;
   float r2_top =  y2;
-  float r1_right = x1 + w2;
+  float r1_right = x1 + w1;
   float r2_right = x2 + w2;
   float r1_bottom = y1 + h1;
   float r2_bottom = y2 + h2;
@@ -715,7 +1516,7 @@ bool rect_contains_rect(const float x1, const float y1, const float w1, const fl
   float r1_top =  y1;
   float r2_left = x2;
   float r2_top =  y2;
-  float r1_right = x1 + w2;
+  float r1_right = x1 + w1;
   float r2_right = x2 + w2;
   float r1_bottom = y1 + h1;
   float r2_bottom = y2 + h2;
@@ -725,6 +1526,714 @@ bool rect_contains_rect(const float x1, const float y1, const float w1, const fl
 
 } // namespace math
 
+// rect batch -------------------------
+namespace math {
+
+static size_t padded_size(size_t n) { return (n + 7) & ~size_t(7); }
+
+void Rect_batch::reserve(size_t n){
+  x.reserve(padded_size(n));
+  y.reserve(padded_size(n));
+  w.reserve(padded_size(n));
+  h.reserve(padded_size(n));
+}
+
+void Rect_batch::clear(){
+  x.clear();
+  y.clear();
+  w.clear();
+  h.clear();
+  count = 0;
+}
+
+uint32_t Rect_batch::push(const Rect& r){
+  if (count == x.size()){
+    const float nan = std::numeric_limits<float>::quiet_NaN();
+    size_t n = padded_size(count + 1);
+    x.resize(n, nan);
+    y.resize(n, nan);
+    w.resize(n, nan);
+    h.resize(n, nan);
+  }
+  x[count] = r.x;
+  y[count] = r.y;
+  w[count] = r.w;
+  h[count] = r.h;
+  return uint32_t(count++);
+}
+
+static bool rect_intersects(const Rect& a, const Rect_batch& b, size_t i){
+  return a.x <= b.x[i] + b.w[i] && a.x + a.w >= b.x[i] && a.y <= b.y[i] + b.h[i] && a.y + a.h >= b.y[i];
+}
+
+static bool rect_contains(const Rect& a, const Rect_batch& b, size_t i){
+  return b.x[i] >= a.x && b.x[i] + b.w[i] <= a.x + a.w && b.y[i] >= a.y && b.y[i] + b.h[i] <= a.y + a.h;
+}
+
+// Calls emit(block, bits) for every block of 8 rects starting at `from`
+// (rounded down to a multiple of 8), with bit k set if rect block*8+k matches.
+template <bool contains, typename Emit>
+static void scan_scalar(const Rect& r, const Rect_batch& b, size_t from, Emit&& emit){
+  for (size_t base = from & ~size_t(7); base < b.size(); base += 8){
+    uint32_t bits = 0;
+    for (size_t k = 0; k < 8; ++k){
+      size_t i = base + k;
+      if (i < b.size() && (contains ? rect_contains(r, b, i) : rect_intersects(r, b, i))) bits |= 1u << k;
+    }
+    emit(base, bits);
+  }
+}
+
+#if defined(STDCPP_X86)
+template <bool contains, typename Emit>
+STDCPP_TARGET_AVX2 static void scan_avx2(const Rect& r, const Rect_batch& b, size_t from, Emit&& emit){
+  const __m256 rx = _mm256_set1_ps(r.x), ry = _mm256_set1_ps(r.y);
+  const __m256 rr = _mm256_set1_ps(r.x + r.w), rb = _mm256_set1_ps(r.y + r.h);
+  for (size_t base = from & ~size_t(7); base < b.size(); base += 8){
+    __m256 bx = _mm256_loadu_ps(b.x.data() + base);
+    __m256 by = _mm256_loadu_ps(b.y.data() + base);
+    __m256 br = _mm256_add_ps(bx, _mm256_loadu_ps(b.w.data() + base));
+    __m256 bb = _mm256_add_ps(by, _mm256_loadu_ps(b.h.data() + base));
+    __m256 m;
+    if constexpr (contains){
+      m = _mm256_and_ps(_mm256_and_ps(_mm256_cmp_ps(bx, rx, _CMP_GE_OQ), _mm256_cmp_ps(br, rr, _CMP_LE_OQ)),
+			_mm256_and_ps(_mm256_cmp_ps(by, ry, _CMP_GE_OQ), _mm256_cmp_ps(bb, rb, _CMP_LE_OQ)));
+    } else {
+      m = _mm256_and_ps(_mm256_and_ps(_mm256_cmp_ps(rx, br, _CMP_LE_OQ), _mm256_cmp_ps(rr, bx, _CMP_GE_OQ)),
+			_mm256_and_ps(_mm256_cmp_ps(ry, bb, _CMP_LE_OQ), _mm256_cmp_ps(rb, by, _CMP_GE_OQ)));
+    }
+    emit(base, uint32_t(_mm256_movemask_ps(m)));
+  }
+}
+#endif
+
+template <bool contains, typename Emit>
+static void scan(const Rect& r, const Rect_batch& b, size_t from, Emit&& emit){
+#if defined(STDCPP_X86)
+  static const bool avx2 = has_avx2();
+  if (avx2){
+    scan_avx2<contains>(r, b, from, emit);
+    return;
+  }
+#endif
+  scan_scalar<contains>(r, b, from, emit);
+}
+
+template <bool contains>
+static size_t scan_mask(const Rect& r, const Rect_batch& b, std::vector<uint64_t>& mask){
+  mask.assign((b.size() + 63) / 64, 0);
+  size_t hits = 0;
+  scan<contains>(r, b, 0, [&](size_t base, uint32_t bits){
+    mask[base / 64] |= uint64_t(bits) << (base % 64);
+    hits += std::popcount(bits);
+  });
+  return hits;
+}
+
+template <bool contains>
+static size_t scan_indices(const Rect& r, const Rect_batch& b, std::vector<uint32_t>& out){
+  size_t before = out.size();
+  scan<contains>(r, b, 0, [&](size_t base, uint32_t bits){
+    while (bits){
+      out.push_back(uint32_t(base + std::countr_zero(bits)));
+      bits &= bits - 1;
+    }
+  });
+  return out.size() - before;
+}
+
+size_t intersects_mask(const Rect& r, const Rect_batch& batch, std::vector<uint64_t>& mask){
+  return scan_mask<false>(r, batch, mask);
+}
+
+size_t contains_mask(const Rect& outer, const Rect_batch& batch, std::vector<uint64_t>& mask){
+  return scan_mask<true>(outer, batch, mask);
+}
+
+size_t intersects_indices(const Rect& r, const Rect_batch& batch, std::vector<uint32_t>& out){
+  return scan_indices<false>(r, batch, out);
+}
+
+size_t contains_indices(const Rect& outer, const Rect_batch& batch, std::vector<uint32_t>& out){
+  return scan_indices<true>(outer, batch, out);
+}
+
+size_t intersecting_pairs(const Rect_batch& batch, std::vector<std::pair<uint32_t, uint32_t>>& out){
+  size_t before = out.size();
+  for (size_t i = 0; i < batch.size(); ++i){
+    scan<false>(batch.get(i), batch, i + 1, [&](size_t base, uint32_t bits){
+      if (base <= i) bits &= ~0u << (i + 1 - base); // only j > i
+      while (bits){
+	out.emplace_back(uint32_t(i), uint32_t(base + std::countr_zero(bits)));
+	bits &= bits - 1;
+      }
+    });
+  }
+  return out.size() - before;
+}
+
+// Rect_grid -------------------------
+int Rect_grid::col_of(float x) const {
+  int c = int(std::floor((x - origin_x) / cell));
+  return std::clamp(c, 0, cols - 1);
+}
+
+int Rect_grid::row_of(float y) const {
+  int r = int(std::floor((y - origin_y) / cell));
+  return std::clamp(r, 0, rows - 1);
+}
+
+void Rect_grid::build(const Rect_batch& batch, float cell_size){
+  cell_start.clear();
+  entries.clear();
+  stamp.assign(batch.size(), 0);
+  query_id = 0;
+  cols = rows = 0;
+  if (batch.empty()) return;
+
+  float min_x = batch.x[0], min_y = batch.y[0], max_x = min_x + batch.w[0], max_y = min_y + batch.h[0];
+  double extent = 0;
+  for (size_t i = 0; i < batch.size(); ++i){
+    min_x = std::min(min_x, batch.x[i]);
+    min_y = std::min(min_y, batch.y[i]);
+    max_x = std::max(max_x, batch.x[i] + batch.w[i]);
+    max_y = std::max(max_y, batch.y[i] + batch.h[i]);
+    extent += std::max(batch.w[i], batch.h[i]);
+  }
+  cell = cell_size > 0.f ? cell_size : float(extent / double(batch.size())) * 2.f;
+  if (!(cell > 0.f)) cell = 1.f;
+
+  // Keep the cell count within a small multiple of the rect count, so a
+  // sparse batch with a few huge outliers doesn't allocate a huge grid.
+  const double max_cells = 4.0 * double(batch.size()) + 16.0;
+  while (double(std::floor((max_x - min_x) / cell) + 1) * double(std::floor((max_y - min_y) / cell) + 1) > max_cells){
+    cell *= 2.f;
+  }
+  origin_x = min_x;
+  origin_y = min_y;
+  cols = int(std::floor((max_x - min_x) / cell)) + 1;
+  rows = int(std::floor((max_y - min_y) / cell)) + 1;
+
+  // Counting sort into cells: count, prefix-sum, then fill.
+  cell_start.assign(size_t(cols) * size_t(rows) + 1, 0);
+  for (size_t i = 0; i < batch.size(); ++i){
+    int c0 = col_of(batch.x[i]), c1 = col_of(batch.x[i] + batch.w[i]);
+    int r0 = row_of(batch.y[i]), r1 = row_of(batch.y[i] + batch.h[i]);
+    for (int r = r0; r <= r1; ++r)
+      for (int c = c0; c <= c1; ++c) cell_start[size_t(r) * cols + c + 1]++;
+  }
+  for (size_t i = 1; i < cell_start.size(); ++i) cell_start[i] += cell_start[i-1];
+  entries.resize(cell_start.back());
+  std::vector<uint32_t> fill(cell_start.begin(), cell_start.end() - 1);
+  for (size_t i = 0; i < batch.size(); ++i){
+    int c0 = col_of(batch.x[i]), c1 = col_of(batch.x[i] + batch.w[i]);
+    int r0 = row_of(batch.y[i]), r1 = row_of(batch.y[i] + batch.h[i]);
+    for (int r = r0; r <= r1; ++r)
+      for (int c = c0; c <= c1; ++c) entries[fill[size_t(r) * cols + c]++] = uint32_t(i);
+  }
+}
+
+size_t Rect_grid::query(const Rect& r, const Rect_batch& batch, std::vector<uint32_t>& out){
+  size_t before = out.size();
+  if (cols == 0) return 0;
+  if (++query_id == 0){
+    std::fill(stamp.begin(), stamp.end(), 0);
+    query_id = 1;
+  }
+  int c0 = col_of(r.x), c1 = col_of(r.x + r.w);
+  int r0 = row_of(r.y), r1 = row_of(r.y + r.h);
+  for (int row = r0; row <= r1; ++row){
+    for (int c = c0; c <= c1; ++c){
+      size_t cell_index = size_t(row) * cols + c;
+      for (uint32_t e = cell_start[cell_index]; e < cell_start[cell_index + 1]; ++e){
+	uint32_t i = entries[e];
+	if (stamp[i] == query_id) continue;
+	stamp[i] = query_id;
+	if (rect_intersects(r, batch, i)) out.push_back(i);
+      }
+    }
+  }
+  return out.size() - before;
+}
+
+size_t Rect_grid::pairs(const Rect_batch& batch, std::vector<std::pair<uint32_t, uint32_t>>& out) const {
+  size_t before = out.size();
+  for (int row = 0; row < rows; ++row){
+    for (int c = 0; c < cols; ++c){
+      size_t cell_index = size_t(row) * cols + c;
+      uint32_t begin = cell_start[cell_index], end = cell_start[cell_index + 1];
+      for (uint32_t a = begin; a < end; ++a){
+	uint32_t i = entries[a];
+	Rect ri = batch.get(i);
+	for (uint32_t b = a + 1; b < end; ++b){
+	  uint32_t j = entries[b];
+	  if (!rect_intersects(ri, batch, j)) continue;
+	  // A pair shares every cell its overlap touches; report it only from
+	  // the cell holding the overlap's top-left corner.
+	  float ox = std::max(ri.x, batch.x[j]), oy = std::max(ri.y, batch.y[j]);
+	  if (col_of(ox) != c || row_of(oy) != row) continue;
+	  out.emplace_back(std::min(i, j), std::max(i, j));
+	}
+      }
+    }
+  }
+  return out.size() - before;
+}
+
+} // namespace math
+
+// arena -------------------------
+namespace arena {
+  static void poison(void* p, size_t n, unsigned char byte){
+#if STDCPP_ARENA_POISON
+    if (n) std::memset(p, byte, n);
+#else
+    (void)p; (void)n; (void)byte;
+#endif
+  }
+
+  static uintptr_t align_up(uintptr_t p, size_t align){
+    return (p + (align - 1)) & ~uintptr_t(align - 1);
+  }
+
+  // The payload starts right after the header, which keeps max_align_t
+  // alignment since the header is three words and chunks come aligned.
+  static char* chunk_data(Chunk* c){
+    return (char*)align_up(uintptr_t(c + 1), alignof(std::max_align_t));
+  }
+
+  static size_t chunk_header(){
+    return align_up(sizeof(Chunk), alignof(std::max_align_t));
+  }
+
+  static Chunk* new_chunk(std::pmr::memory_resource* upstream, size_t size){
+    Chunk* c = (Chunk*)upstream->allocate(chunk_header() + size, alignof(std::max_align_t));
+    c->next = nullptr;
+    c->size = size;
+    c->used = 0;
+    return c;
+  }
+
+  static void free_chunk(std::pmr::memory_resource* upstream, Chunk* c){
+    upstream->deallocate(c, chunk_header() + c->size, alignof(std::max_align_t));
+  }
+
+  Bump_arena::Bump_arena(size_t capacity, std::pmr::memory_resource* _upstream)
+    : base((char*)_upstream->allocate(capacity, alignof(std::max_align_t))), cap(capacity), upstream(_upstream) {
+    poison(base, cap, 0xDD);
+  }
+
+  Bump_arena::Bump_arena(void* buffer, size_t capacity) : base((char*)buffer), cap(capacity) {
+    poison(base, cap, 0xDD);
+  }
+
+  Bump_arena::~Bump_arena(){
+    if (upstream) upstream->deallocate(base, cap, alignof(std::max_align_t));
+  }
+
+  void Bump_arena::reset(Mark m){
+    ASSERT(m <= used);
+    poison(base + m, used - m, 0xDD);
+    used = m;
+  }
+
+  void* Bump_arena::do_allocate(size_t bytes, size_t align){
+    size_t at = size_t(align_up(uintptr_t(base) + used, align) - uintptr_t(base));
+    if (at > cap || bytes > cap - at) throw std::bad_alloc();
+    used = at + bytes;
+    poison(base + at, bytes, 0xCD);
+    return base + at;
+  }
+
+  Chunked_arena::Chunked_arena(size_t first_chunk, std::pmr::memory_resource* _upstream)
+    : next_size(first_chunk ? first_chunk : 1), upstream(_upstream) { }
+
+  Chunked_arena::~Chunked_arena(){
+    release();
+  }
+
+  void Chunked_arena::reset(Mark m){
+    // every chunk from the mark's up to the current one gives back what it
+    // handed out after the mark
+    Chunk* c = m.chunk ? m.chunk : first;
+    size_t from = m.chunk ? m.used : 0;
+    while (c){
+      poison(chunk_data(c) + from, c->used - from, 0xDD);
+      c->used = from;
+      if (c == current) break;
+      c = c->next;
+      from = 0;
+    }
+    current = m.chunk;
+    total = m.total;
+  }
+
+  void Chunked_arena::release(){
+    while (first){
+      Chunk* next = first->next;
+      free_chunk(upstream, first);
+      first = next;
+    }
+    current = nullptr;
+    total = 0;
+    held = 0;
+  }
+
+  void* Chunked_arena::do_allocate(size_t bytes, size_t align){
+    if (current){
+      char* data = chunk_data(current);
+      size_t at = size_t(align_up(uintptr_t(data) + current->used, align) - uintptr_t(data));
+      if (at <= current->size && bytes <= current->size - at){
+	total += at + bytes - current->used;
+	current->used = at + bytes;
+	poison(data + at, bytes, 0xCD);
+	return data + at;
+      }
+    }
+    // the next kept chunk if it fits, else a new one in front of it; chunk
+    // payloads are max_align_t aligned, so `align - 1` bytes of slack cover
+    // any stricter alignment
+    size_t need = bytes + (align > alignof(std::max_align_t) ? align - 1 : 0);
+    Chunk* next = current ? current->next : first;
+    if (!next || next->size < need){
+      size_t size = std::max(next_size, need);
+      next_size = size * 2;
+      Chunk* c = new_chunk(upstream, size);
+      held += size;
+      c->next = next;
+      if (current) current->next = c;
+      else first = c;
+      next = c;
+    }
+    current = next;
+    char* data = chunk_data(current);
+    size_t at = size_t(align_up(uintptr_t(data), align) - uintptr_t(data));
+    current->used = at + bytes;
+    total += at + bytes;
+    poison(data + at, bytes, 0xCD);
+    return data + at;
+  }
+
+  Pool::Pool(size_t block_size, size_t block_align, std::pmr::memory_resource* _upstream)
+    : align(std::max(block_align, alignof(Free))), upstream(_upstream) {
+    block = size_t(align_up(std::max(block_size, sizeof(Free)), align));
+  }
+
+  Pool::~Pool(){
+    release();
+  }
+
+  void Pool::reset(){
+    for (Chunk* c = first; c; c = c->next) poison(chunk_data(c), c->size, 0xDD);
+    free_list = nullptr;
+    carving = nullptr;
+    carve_cur = carve_end = nullptr;
+    live_blocks = 0;
+  }
+
+  void Pool::release(){
+    reset();
+    while (first){
+      Chunk* next = first->next;
+      free_chunk(upstream, first);
+      first = next;
+    }
+    last = nullptr;
+    next_blocks = 64;
+  }
+
+  void* Pool::do_allocate(size_t bytes, size_t a){
+    if (bytes > block || a > align) return upstream->allocate(bytes, a);
+    void* p;
+    if (free_list){
+      p = free_list;
+      free_list = free_list->next;
+    } else {
+      if (size_t(carve_end - carve_cur) < block){
+	Chunk* c = carving ? carving->next : first;
+	if (!c){
+	  c = new_chunk(upstream, next_blocks * block + align);
+	  next_blocks *= 2;
+	  if (last) last->next = c;
+	  else first = c;
+	  last = c;
+	}
+	carving = c;
+	carve_cur = (char*)align_up(uintptr_t(chunk_data(c)), align);
+	carve_end = carve_cur + (chunk_data(c) + c->size - carve_cur) / block * block;
+      }
+      p = carve_cur;
+      carve_cur += block;
+    }
+    live_blocks++;
+    poison(p, block, 0xCD);
+    return p;
+  }
+
+  void Pool::do_deallocate(void* p, size_t bytes, size_t a){
+    if (bytes > block || a > align){
+      upstream->deallocate(p, bytes, a);
+      return;
+    }
+    poison(p, block, 0xDD);
+    Free* f = (Free*)p;
+    f->next = free_list;
+    free_list = f;
+    live_blocks--;
+  }
+} // namespace arena
+
+// job -------------------------
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace job {
+  // Idle rounds a thread yields through before it goes to sleep.
+  static constexpr int idle_spins = 64;
+
+  static thread_local Pool* worker_pool{nullptr};
+  static thread_local int worker_index{-1};
+  static thread_local uint64_t victim_state{0x9E3779B97F4A7C15ull};
+
+  static void pin_thread(std::thread& t, int cpu){
+#if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    pthread_setaffinity_np(t.native_handle(), sizeof(set), &set);
+#elif defined USE_WIN32
+    SetThreadAffinityMask((HANDLE)t.native_handle(), DWORD_PTR(1) << cpu);
+#else
+    (void)t;
+    (void)cpu;
+#endif
+  }
+
+  Deque::Deque(size_t capacity){
+    rings.push_back(new Ring(int64_t(std::bit_ceil(std::max<size_t>(capacity, 2)))));
+    ring.store(rings.back(), std::memory_order_relaxed);
+  }
+
+  Deque::~Deque(){
+    for (Ring* r : rings) delete r;
+  }
+
+  void Deque::push(Task* task){
+    int64_t b = bottom.load(std::memory_order_relaxed);
+    int64_t t = top.load(std::memory_order_acquire);
+    Ring* r = ring.load(std::memory_order_relaxed);
+    if (b - t > r->mask){
+      Ring* bigger = new Ring((r->mask + 1) * 2);
+      for (int64_t i = t; i < b; ++i) bigger->put(i, r->get(i));
+      rings.push_back(bigger);
+      ring.store(bigger, std::memory_order_release);
+      r = bigger;
+    }
+    r->put(b, task);
+    bottom.store(b + 1, std::memory_order_release);
+  }
+
+  Task* Deque::pop(){
+    int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+    Ring* r = ring.load(std::memory_order_relaxed);
+    bottom.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t t = top.load(std::memory_order_relaxed);
+    if (t > b){
+      bottom.store(b + 1, std::memory_order_relaxed);
+      return nullptr;
+    }
+    Task* task = r->get(b);
+    if (t == b){
+      // the last task: race the thieves for it
+      if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) task = nullptr;
+      bottom.store(b + 1, std::memory_order_relaxed);
+    }
+    return task;
+  }
+
+  Task* Deque::steal(){
+    int64_t t = top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t b = bottom.load(std::memory_order_acquire);
+    if (t >= b) return nullptr;
+    Task* task = ring.load(std::memory_order_acquire)->get(t);
+    if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) return nullptr;
+    return task;
+  }
+
+  Pool::Pool(int workers, bool pin){
+    int hardware = int(std::max(1u, std::thread::hardware_concurrency()));
+    if (workers < 0) workers = hardware - 1;
+    for (int i = 0; i < workers; ++i) deques.push_back(std::make_unique<Deque>());
+    for (int i = 0; i < workers; ++i){
+      threads.emplace_back([this, i](){ worker_loop(i); });
+      if (pin) pin_thread(threads.back(), (i + 1) % hardware);
+    }
+  }
+
+  Pool::~Pool(){
+    while (run_one()) { }
+    stopping.store(true);
+    epoch.fetch_add(1);
+    epoch.notify_all();
+    for (auto& t : threads) t.join();
+  }
+
+  void Pool::submit(Task* task){
+    if (worker_pool == this){
+      deques[worker_index]->push(task);
+    } else {
+      std::lock_guard<std::mutex> lock(injected_lock);
+      injected.push_back(task);
+      injected_count.fetch_add(1, std::memory_order_release);
+    }
+    wake_one();
+  }
+
+  bool Pool::local_empty() const {
+    if (worker_pool == this) return deques[worker_index]->empty();
+    return injected_count.load(std::memory_order_relaxed) == 0;
+  }
+
+  bool Pool::run_one(){
+    Task* task = find_task();
+    if (!task) return false;
+    execute(task);
+    return true;
+  }
+
+  // The caller's own deque first, then the shared queue, then a steal from
+  // each other worker, starting at a random one.
+  Task* Pool::find_task(){
+    bool own = worker_pool == this;
+    if (own){
+      if (Task* task = deques[worker_index]->pop()) return task;
+    }
+    if (injected_count.load(std::memory_order_acquire) > 0){
+      std::lock_guard<std::mutex> lock(injected_lock);
+      if (!injected.empty()){
+	Task* task = injected.front();
+	injected.pop_front();
+	injected_count.fetch_sub(1, std::memory_order_relaxed);
+	return task;
+      }
+    }
+    size_t n = deques.size();
+    if (n == 0) return nullptr;
+    victim_state ^= victim_state << 13;
+    victim_state ^= victim_state >> 7;
+    victim_state ^= victim_state << 17;
+    size_t start = size_t(victim_state % n);
+    for (size_t k = 0; k < n; ++k){
+      size_t i = (start + k) % n;
+      if (own && int(i) == worker_index) continue;
+      if (Task* task = deques[i]->steal()) return task;
+    }
+    return nullptr;
+  }
+
+  void Pool::execute(Task* task){
+    Group* group = task->group;
+    std::exception_ptr error;
+    try {
+      task->run();
+    } catch (...) {
+      error = std::current_exception();
+    }
+    delete task;
+    group->finish(error);
+  }
+
+  void Pool::worker_loop(int index){
+    worker_pool = this;
+    worker_index = index;
+    victim_state += uint64_t(index) * 0xBF58476D1CE4E5B9ull;
+    int spins = 0;
+    while (true){
+      if (Task* task = find_task()){
+	execute(task);
+	spins = 0;
+	continue;
+      }
+      if (stopping.load()) break;
+      if (++spins < idle_spins){
+	std::this_thread::yield();
+	continue;
+      }
+      idle(nullptr);
+      spins = 0;
+    }
+  }
+
+  // Announces the sleeper before the last look for work; submit() and
+  // finish() publish their change before they check for sleepers, so one
+  // of the two sides always sees the other.
+  void Pool::idle(const std::atomic<size_t>* pending){
+    uint32_t e = epoch.load();
+    sleepers.fetch_add(1);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    Task* task = find_task();
+    bool done = pending ? pending->load() == 0 : stopping.load();
+    if (!task && !done) epoch.wait(e);
+    sleepers.fetch_sub(1);
+    if (task) execute(task);
+  }
+
+  void Pool::wake_one(){
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (sleepers.load(std::memory_order_relaxed) == 0) return;
+    epoch.fetch_add(1);
+    epoch.notify_one();
+  }
+
+  void Pool::wake_all(){
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (sleepers.load(std::memory_order_relaxed) == 0) return;
+    epoch.fetch_add(1);
+    epoch.notify_all();
+  }
+
+  Group::~Group(){
+    drain();
+  }
+
+  void Group::wait(){
+    drain();
+    if (error){
+      std::exception_ptr e = std::move(error);
+      error = nullptr;
+      std::rethrow_exception(e);
+    }
+  }
+
+  void Group::drain(){
+    int spins = 0;
+    while (pending.load(std::memory_order_acquire) != 0){
+      if (pool.run_one()){
+	spins = 0;
+      } else if (++spins < idle_spins){
+	std::this_thread::yield();
+      } else {
+	pool.idle(&pending);
+	spins = 0;
+      }
+    }
+  }
+
+  // The group may be gone once `pending` reaches 0, so `pool` is read first.
+  void Group::finish(std::exception_ptr e){
+    if (e){
+      std::lock_guard<std::mutex> lock(error_lock);
+      if (!error) error = e;
+    }
+    Pool& p = pool;
+    if (pending.fetch_sub(1, std::memory_order_acq_rel) == 1) p.wake_all();
+  }
+} // namespace job
+
 namespace file {
   std::string slurp_file(const std::string& filename){
     std::ifstream ifs;
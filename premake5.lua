@@ -1,3 +1,18 @@
+-- src/prelude.hpp embeds src/prelude.hash as a string literal, which the
+-- compiler tokenizes with its constexpr lexer while it is being built.
+local function embed_source(src, dst, name)
+    local f = assert(io.open(path.join(_SCRIPT_DIR, src), "rb"))
+    local text = f:read("*a"):gsub("\r", "")
+    f:close()
+    local out = assert(io.open(path.join(_SCRIPT_DIR, dst), "wb"))
+    out:write("// Generated by premake5.lua from " .. src .. ". Do not edit.\n")
+    out:write("#pragma once\n\n")
+    out:write("static constexpr std::string_view " .. name .. " = R\"hash(" .. text .. ")hash\";\n")
+    out:close()
+end
+
+embed_source("src/prelude.hash", "src/prelude.hpp", "prelude_source")
+
 workspace "hash"
     configurations {"Debug", "Release"}
     location "build"
@@ -10,7 +25,53 @@ project "hash"
     staticruntime "On"
     targetdir "bin/%{cfg.buildcfg}"
 
-files {"src/main.cpp"}
+files {"src/main.cpp", "src/prelude.hash", "src/prelude.hpp", "src/unicode_tables.hpp"}
+includedirs {"include"}
+
+filter "configurations:Debug"
+    runtime "Debug"
+    defines {"DEBUG"}
+    symbols "On"
+
+filter "configurations:Release"
+    runtime "Release"
+    defines {"NDEBUG"}
+    optimize "On"
+
+filter {}
+----------------------------------------------------
+project "option_bench"
+    kind "ConsoleApp"
+    language "C++"
+    architecture "x64"
+    cppdialect "c++latest"
+    staticruntime "On"
+    targetdir "bin/%{cfg.buildcfg}"
+
+files {"bench/option_bench.cpp"}
+includedirs {"include"}
+
+filter "configurations:Debug"
+    runtime "Debug"
+    defines {"DEBUG"}
+    symbols "On"
+
+filter "configurations:Release"
+    runtime "Release"
+    defines {"NDEBUG"}
+    optimize "On"
+
+filter {}
+
+project "stdcpp_bench"
+    kind "ConsoleApp"
+    language "C++"
+    architecture "x64"
+    cppdialect "c++latest"
+    staticruntime "On"
+    targetdir "bin/%{cfg.buildcfg}"
+
+files {"bench/stdcpp_bench.cpp"}
 includedirs {"include"}
 
 filter "configurations:Debug"
@@ -24,4 +85,3 @@ filter "configurations:Release"
     optimize "On"
 
 filter {}
-----------------------------------------------------
\ No newline at end of file
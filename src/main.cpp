@@ -3,8 +3,346 @@
 #include <stack>
 #include <filesystem>
 #include <unordered_map>
+#include <unordered_set>
+#include <thread>
+#include <chrono>
+#include <bit>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <new>
+#include <cstring>
+#include <array>
+#include <climits>
+#include <charconv>
+#include <functional>
 namespace fs = std::filesystem;
 
+// Allocation profiling --------------------------------------------------
+// The global operator new/delete count allocations, bytes and the peak of
+// live bytes per compiler phase and per call site once `--mem-report`
+// turns profiling on. Sizes come from the allocator itself, so blocks carry
+// no header and the disabled path is one relaxed load, in the allocator and
+// in MEM_SITE() alike.
+#if defined(_WIN32)
+#include <malloc.h>
+#define alloc_size(p) _msize(p)
+#define aligned_alloc_size(p, align) _aligned_msize(p, align, 0)
+#elif defined(__APPLE__)
+#include <malloc/malloc.h>
+#define alloc_size(p) malloc_size(p)
+#define aligned_alloc_size(p, align) malloc_size(p)
+#else
+#include <malloc.h>
+#define alloc_size(p) malloc_usable_size(p)
+#define aligned_alloc_size(p, align) malloc_usable_size(p)
+#endif
+
+namespace mem {
+  enum class Phase {
+    Startup,
+    Read,
+    Lex,
+    Parse,
+    Check,
+    Count
+  };
+
+  static const char* phase_names[] = {"startup", "read", "lex", "parse", "check"};
+
+  struct Counters {
+    std::atomic<int64_t> allocs{0}, frees{0}, bytes{0}, peak{0};
+  };
+
+  struct Site;
+  std::atomic<bool> profiling{false};
+  std::atomic<int64_t> live{0};
+  std::atomic<int> phase{int(Phase::Startup)};
+  Counters phases[int(Phase::Count)];
+  Site* sites{nullptr}; // intrusive list of every Site that was entered
+  thread_local Site* current_site{nullptr};
+
+  // A named allocation site; a static one per MEM_SITE() use.
+  struct Site {
+    const char* name;
+    Counters counters;
+    Site* next{nullptr};
+    std::atomic<bool> linked{false};
+
+    Site(const char* _name) : name(_name) { }
+  };
+
+  struct Site_scope {
+    Site* prev{nullptr};
+    bool active{false};
+    Site_scope(Site& site) {
+      if (!profiling.load(std::memory_order_relaxed)) return;
+      if (!site.linked.load(std::memory_order_relaxed) && !site.linked.exchange(true)){
+	static std::mutex m;
+	std::lock_guard<std::mutex> lock(m);
+	site.next = sites;
+	sites = &site;
+      }
+      active = true;
+      prev = current_site;
+      current_site = &site;
+    }
+    ~Site_scope(){ if (active) current_site = prev; }
+  };
+
+  void update_peak(std::atomic<int64_t>& peak, int64_t value){
+    int64_t p = peak.load(std::memory_order_relaxed);
+    while (value > p && !peak.compare_exchange_weak(p, value, std::memory_order_relaxed)) { }
+  }
+
+  void on_alloc(int64_t size){
+    int64_t now = live.fetch_add(size, std::memory_order_relaxed) + size;
+    Counters& ph = phases[phase.load(std::memory_order_relaxed)];
+    ph.allocs.fetch_add(1, std::memory_order_relaxed);
+    ph.bytes.fetch_add(size, std::memory_order_relaxed);
+    update_peak(ph.peak, now);
+    if (current_site){
+      current_site->counters.allocs.fetch_add(1, std::memory_order_relaxed);
+      current_site->counters.bytes.fetch_add(size, std::memory_order_relaxed);
+    }
+  }
+
+  // A block allocated before profiling started cannot be told apart from
+  // one allocated after, so `live` stops at zero rather than going negative.
+  void on_free(int64_t size){
+    int64_t l = live.load(std::memory_order_relaxed);
+    while (!live.compare_exchange_weak(l, std::max<int64_t>(l - size, 0), std::memory_order_relaxed)) { }
+    phases[phase.load(std::memory_order_relaxed)].frees.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  // Peak live bytes of a phase start from what is live when it is entered.
+  void set_phase(Phase p){
+    phase.store(int(p), std::memory_order_relaxed);
+    update_peak(phases[int(p)].peak, live.load(std::memory_order_relaxed));
+  }
+
+  void report(){
+    profiling = false;
+    auto mb = [](int64_t b){ return double(b) / (1024.0 * 1024.0); };
+    fprint(std::cerr, "{:<10}{:>12}{:>12}{:>14}{:>16}\n", "phase", "allocs", "frees", "bytes (MB)", "peak live (MB)");
+    for (int i = 0; i < int(Phase::Count); ++i){
+      Counters& c = phases[i];
+      fprint(std::cerr, "{:<10}{:>12}{:>12}{:>14.2f}{:>16.2f}\n", phase_names[i], c.allocs.load(), c.frees.load(), mb(c.bytes.load()), mb(c.peak.load()));
+    }
+
+    std::vector<Site*> by_bytes;
+    for (Site* s = sites; s; s = s->next) by_bytes.push_back(s);
+    std::sort(by_bytes.begin(), by_bytes.end(), [](Site* a, Site* b){ return a->counters.bytes > b->counters.bytes; });
+    fprint(std::cerr, "\n{:<28}{:>12}{:>14}\n", "top sites", "allocs", "bytes (MB)");
+    for (size_t i = 0; i < by_bytes.size() && i < 10; ++i){
+      Counters& c = by_bytes[i]->counters;
+      fprint(std::cerr, "{:<28}{:>12}{:>14.2f}\n", by_bytes[i]->name, c.allocs.load(), mb(c.bytes.load()));
+    }
+  }
+} // namespace mem
+
+#define MEM_CONCAT_(a, b) a##b
+#define MEM_CONCAT(a, b) MEM_CONCAT_(a, b)
+#define MEM_SITE(name) static mem::Site MEM_CONCAT(_mem_site_, __LINE__)(name); mem::Site_scope MEM_CONCAT(_mem_scope_, __LINE__)(MEM_CONCAT(_mem_site_, __LINE__))
+
+void* operator new(size_t size){
+  void* p = std::malloc(size ? size : 1);
+  if (!p) throw std::bad_alloc();
+  if (mem::profiling.load(std::memory_order_relaxed)) mem::on_alloc(int64_t(alloc_size(p)));
+  return p;
+}
+void* operator new[](size_t size){ return operator new(size); }
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+  void* p = std::malloc(size ? size : 1);
+  if (p && mem::profiling.load(std::memory_order_relaxed)) mem::on_alloc(int64_t(alloc_size(p)));
+  return p;
+}
+void* operator new[](size_t size, const std::nothrow_t& nt) noexcept { return operator new(size, nt); }
+void operator delete(void* p) noexcept {
+  if (!p) return;
+  if (mem::profiling.load(std::memory_order_relaxed)) mem::on_free(int64_t(alloc_size(p)));
+  std::free(p);
+}
+void operator delete[](void* p) noexcept { operator delete(p); }
+void operator delete(void* p, size_t) noexcept { operator delete(p); }
+void operator delete[](void* p, size_t) noexcept { operator delete(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { operator delete(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { operator delete(p); }
+
+// over-aligned types, e.g. the alignas(64) job::Deque
+void* operator new(size_t size, std::align_val_t align){
+  size_t a = std::max(size_t(align), sizeof(void*));
+#if defined(_WIN32)
+  void* p = _aligned_malloc(size ? size : 1, a);
+#else
+  void* p = nullptr;
+  if (posix_memalign(&p, a, size ? size : 1) != 0) p = nullptr;
+#endif
+  if (!p) throw std::bad_alloc();
+  if (mem::profiling.load(std::memory_order_relaxed)) mem::on_alloc(int64_t(aligned_alloc_size(p, a)));
+  return p;
+}
+void* operator new[](size_t size, std::align_val_t align){ return operator new(size, align); }
+void* operator new(size_t size, std::align_val_t align, const std::nothrow_t&) noexcept {
+  try { return operator new(size, align); } catch (std::bad_alloc&) { return nullptr; }
+}
+void* operator new[](size_t size, std::align_val_t align, const std::nothrow_t& nt) noexcept { return operator new(size, align, nt); }
+void operator delete(void* p, std::align_val_t align) noexcept {
+#if defined(_WIN32)
+  if (!p) return;
+  size_t a = std::max(size_t(align), sizeof(void*));
+  if (mem::profiling.load(std::memory_order_relaxed)) mem::on_free(int64_t(aligned_alloc_size(p, a)));
+  _aligned_free(p);
+#else
+  // posix_memalign() blocks are freed like malloc()'s
+  (void)align;
+  operator delete(p);
+#endif
+}
+void operator delete[](void* p, std::align_val_t align) noexcept { operator delete(p, align); }
+void operator delete(void* p, size_t, std::align_val_t align) noexcept { operator delete(p, align); }
+void operator delete[](void* p, size_t, std::align_val_t align) noexcept { operator delete(p, align); }
+void operator delete(void* p, std::align_val_t align, const std::nothrow_t&) noexcept { operator delete(p, align); }
+void operator delete[](void* p, std::align_val_t align, const std::nothrow_t&) noexcept { operator delete(p, align); }
+
+// Atoms --------------------------------------------------
+// Every distinct identifier is interned once into a dense 32-bit Atom, so
+// later stages compare and hash names as integers. The table is split into
+// shards by hash, each with its own lock, so lexer threads can intern
+// concurrently. Names live in per-shard arena blocks and never move; the
+// entries are stored in chunks that double in size and are never
+// reallocated, so a directory of a few pointers inside the table covers
+// every Atom and str()/hash() need no lock. Atom 0 is the empty string.
+typedef uint32_t Atom;
+
+struct Atom_table {
+  struct Entry {
+    const char* data;
+    uint32_t size;
+    uint32_t hash;
+  };
+
+  static constexpr int SHARD_BITS = 6;
+  static constexpr int FIRST_CHUNK_BITS = 10;
+  static constexpr size_t CHUNK_COUNT = 32 - FIRST_CHUNK_BITS + 1;
+  static constexpr size_t BLOCK_SIZE = 64 * 1024;
+  static constexpr Atom EMPTY_SLOT = ~Atom(0);
+
+  struct Shard {
+    std::mutex mutex;
+    std::vector<Atom> slots; // open addressing, EMPTY_SLOT when free
+    size_t count{0};
+    std::vector<std::unique_ptr<char[]>> blocks;
+    char* block_at{nullptr};
+    size_t block_left{0};
+  };
+
+  Shard shards[size_t(1) << SHARD_BITS];
+  std::atomic<Entry*> chunks[CHUNK_COUNT]{}; // chunk k holds 2^(FIRST_CHUNK_BITS + k) entries
+  std::atomic<uint32_t> next{0};
+
+  Atom_table(){ intern(""); }
+
+  ~Atom_table(){
+    for (auto& chunk : chunks){
+      delete[] chunk.load(std::memory_order_relaxed);
+    }
+  }
+
+  // The chunk that holds `a` and its index there.
+  static void locate(Atom a, size_t& chunk, size_t& index){
+    uint64_t x = uint64_t(a) + (uint64_t(1) << FIRST_CHUNK_BITS);
+    int top = std::bit_width(x) - 1;
+    chunk = size_t(top - FIRST_CHUNK_BITS);
+    index = size_t(x - (uint64_t(1) << top));
+  }
+
+  static uint32_t hash_of(std::string_view s){
+    uint64_t h = 14695981039346656037ull;
+    for (char c : s){
+      h = (h ^ uint8_t(c)) * 1099511628211ull;
+    }
+    return uint32_t(h ^ (h >> 32));
+  }
+
+  const Entry& entry(Atom a) const {
+    size_t c, i;
+    locate(a, c, i);
+    return chunks[c].load(std::memory_order_acquire)[i];
+  }
+
+  std::string_view str(Atom a) const {
+    const Entry& e = entry(a);
+    return {e.data, e.size};
+  }
+
+  uint32_t hash(Atom a) const { return entry(a).hash; }
+
+  uint32_t size() const { return next.load(std::memory_order_acquire); }
+
+  Atom intern(std::string_view s){
+    uint32_t h = hash_of(s);
+    Shard& shard = shards[h >> (32 - SHARD_BITS)];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    if ((shard.count + 1) * 2 > shard.slots.size()) grow(shard);
+    size_t mask = shard.slots.size() - 1;
+    size_t i = h & mask;
+    while (shard.slots[i] != EMPTY_SLOT){
+      const Entry& e = entry(shard.slots[i]);
+      if (e.hash == h && std::string_view(e.data, e.size) == s) return shard.slots[i];
+      i = (i + 1) & mask;
+    }
+
+    MEM_SITE("Atom_table");
+    Atom a = next.fetch_add(1, std::memory_order_relaxed);
+    size_t c, index;
+    locate(a, c, index);
+    Entry* chunk = chunks[c].load(std::memory_order_acquire);
+    if (!chunk){
+      Entry* fresh = new Entry[size_t(1) << (FIRST_CHUNK_BITS + c)];
+      if (chunks[c].compare_exchange_strong(chunk, fresh, std::memory_order_acq_rel)){
+	chunk = fresh;
+      } else {
+	delete[] fresh;
+      }
+    }
+    chunk[index] = {store(shard, s), uint32_t(s.size()), h};
+    shard.slots[i] = a;
+    shard.count++;
+    return a;
+  }
+
+private:
+  const char* store(Shard& shard, std::string_view s){
+    if (s.size() > shard.block_left){
+      size_t size = std::max(BLOCK_SIZE, s.size());
+      shard.blocks.emplace_back(new char[size]);
+      shard.block_at = shard.blocks.back().get();
+      shard.block_left = size;
+    }
+    char* res = shard.block_at;
+    std::memcpy(res, s.data(), s.size());
+    shard.block_at += s.size();
+    shard.block_left -= s.size();
+    return res;
+  }
+
+  void grow(Shard& shard){
+    std::vector<Atom> old = std::move(shard.slots);
+    shard.slots.assign(old.empty() ? 64 : old.size() * 2, EMPTY_SLOT);
+    size_t mask = shard.slots.size() - 1;
+    for (Atom a : old){
+      if (a == EMPTY_SLOT) continue;
+      size_t i = entry(a).hash & mask;
+      while (shard.slots[i] != EMPTY_SLOT) i = (i + 1) & mask;
+      shard.slots[i] = a;
+    }
+  }
+};
+
+Atom_table atoms;
+
 struct Loc{
   int col{0}, row{0};
   std::string file_path;
@@ -18,6 +356,7 @@ struct Token{
   enum class Type{
     Name,
     Number,
+    Float,
     Open_paren,
     Close_paren,
     Semi_colon,
@@ -39,6 +378,9 @@ struct Token{
   } type;
   std::string value;
   Loc loc;
+  size_t offset{0}; // of the first byte in the file's source text
+  Atom atom{0};     // of `value`, for Name tokens
+  int64_t number{0}; // the value of a Number, the bit pattern of a Float's double
 
   std::string type_as_str(){
     switch (type){
@@ -48,6 +390,9 @@ struct Token{
     case Type::Number: {
       return "Number";
     } break;
+    case Type::Float: {
+      return "Float";
+    } break;
     case Type::Open_paren: {
       return "Open_paren";
     } break;
@@ -116,448 +461,4690 @@ struct Token{
 
 typedef std::vector<Token> Tokens;
 
+#define TOKEN_TYPE_COUNT (int(Token::Type::Char) + 1)
+
+// parse_tokens() reverses the token stream first, so the next token is
+// always at the back and popping it is O(1).
 Option<Token> pop_token(std::vector<Token>& tokens){
   Option<Token> res;
   if (!tokens.empty()){
-    res = tokens[0];
-    tokens.erase(tokens.begin() + 0);
+    res.emplace(std::move(tokens.back()));
+    tokens.pop_back();
   }
   return res;  
 }
 
+// Thrown instead of exiting when `errors_are_fatal` is off (the daemon).
+struct Compile_error {
+  std::string message;
+};
+
+thread_local bool errors_are_fatal = true;
+
+[[noreturn]] void fatal_error(const std::string& message){
+  if (!errors_are_fatal) throw Compile_error{message};
+  fprint(std::cerr, "{}", message);
+  exit(1);
+}
+
 #define compiler_error(tok, str, ...) compiler_error_impl(tok, FMT(str, __VA_ARGS__))
 
 void compiler_error_impl(const Token& token, const std::string& err_msg){
-  fprint(std::cerr, "{}: ERROR: {}\n", token.loc.as_str(), err_msg);
-  exit(1);
+  fatal_error(FMT("{}: ERROR: {}\n", token.loc.as_str(), err_msg));
 }
 
 #define FILE_EXT "hash"
+#define LEX_PARALLEL_MIN_SIZE (1024*1024)
 
-Tokens parse_source_file(const std::string& filename){
-  std::string file_ext = str::rpop_until(filename, '.');
-  if (file_ext != FILE_EXT){
-    fprint(std::cerr, "ERROR: Hash source files must have the extension `{}`!\n", FILE_EXT);
-    exit(1);
-  }
-  std::string file = file::slurp_file(filename);
-  Tokens res;
-  if (file.empty()){
-    print("WARNING: File {} is empty\n", filename);
-    return res;
-  }
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define HASH_SSE2
+#endif
+
+// Lexer core --------------------------------------------------
+// The scanner is constexpr and reports what it finds to a sink, so the same
+// code lexes source files at run time (lex_lines) and embedded sources such
+// as the prelude while the compiler itself is being built (lex_static).
+// A sink provides:
+//   push(type, begin, end, row, col)  a token spanning src[begin .. end)
+//   error(row, col, message)          a lex error; must not return
+//   unknown(c)                        a character that starts no token; must not return
+#include "unicode_tables.hpp"
 
-  file = str::trim(file);
-  file = str::remove_char(file, '\r');
-  int col = 1, row = 1;
+constexpr bool lex_isalpha(char c){ return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'); }
+constexpr bool lex_isdigit(char c){ return c >= '0' && c <= '9'; }
 
+constexpr bool xid_start(char32_t c){
+  if (c >= char32_t(XID_BLOCKS) << XID_BLOCK_BITS) return false;
+  const uint64_t* leaf = xid_leaves[xid_index[c >> XID_BLOCK_BITS]];
+  return (leaf[(c & 255) >> 6] >> (c & 63)) & 1;
+}
 
-  while (!file.empty()){
-    
-    std::string line = str::lpop_until(file, '\n');
-    line += '\n';
-    file = str::lremove(file, line.size());
+constexpr bool xid_continue(char32_t c){
+  if (c >= char32_t(XID_BLOCKS) << XID_BLOCK_BITS) return false;
+  const uint64_t* leaf = xid_leaves[xid_index[c >> XID_BLOCK_BITS]];
+  return (leaf[4 + ((c & 255) >> 6)] >> (c & 63)) & 1;
+}
 
-    auto isnotalpha = [](const char& ch){
-      return !ch::isalpha(ch);
-    };
-    auto isnotdigit = [](const char& ch){
-      return !ch::isdigit(ch);
-    };
-    
-    while (!line.empty()) {
-      Token token;
-      token.loc.file_path = fs::absolute(fs::path(filename)).string();
-      token.loc.col = col;
-      token.loc.row = row;
-      if (ch::isalpha(line[0])) {
-	token.value = str::lpop_until(line, isnotalpha);
-	token.type = Token::Type::Name;
-	line = str::lremove(line, token.value.size());
-        res.push_back(token);
-      } else if (ch::isdigit(line[0])){
-	token.value = str::lpop_until(line, isnotdigit);
-	token.type = Token::Type::Number;
-	line = str::lremove(line, token.value.size());
-	res.push_back(token);	
-      } else if (line[0] == '(') {
-	token.value = str::lpop(line, 1);
-	token.type = Token::Type::Open_paren;
-	line = str::lremove(line, 1);
-	res.push_back(token);
-      } else if (line[0] == ')') {
-	token.value = str::lpop(line, 1);
-	token.type = Token::Type::Close_paren;
-	line = str::lremove(line, 1);
-	res.push_back(token);
-      } else if (line[0] == ','){
-	token.value = str::lpop(line, 1);
-	token.type = Token::Type::Comma;
-	line = str::lremove(line, 1);
-	res.push_back(token);
-      } else if (line[0] == ';'){
-	token.value = str::lpop(line, 1);
-	token.type = Token::Type::Semi_colon;
-	line = str::lremove(line, 1);
-	res.push_back(token);
-      } else if (line[0] == '-'){
-	token.value = str::lpop(line, 1);
-	if (line.size() > 1 && line[1] == '>'){
-	  token.value += '>';
-	  token.type = Token::Type::Returner;
-	  line = str::lremove(line, 2);
-	} else {
-	  token.type = Token::Type::Minus;
-	  line = str::lremove(line, 1);
-	}
-	res.push_back(token);
-      } else if (line[0] == '+'){
-	token.value = str::lpop(line, 1);
-	token.type = Token::Type::Plus;
-	line = str::lremove(line, 1);
-	res.push_back(token);
-      } else if (line[0] == '*'){
-	token.value = str::lpop(line, 1);
-	token.type = Token::Type::Mult;
-	line = str::lremove(line, 1);
-	res.push_back(token);
-      } else if (line[0] == '{'){
-	token.value = str::lpop(line, 1);
-	token.type = Token::Type::Open_curl;
-	line = str::lremove(line, 1);
-	res.push_back(token);
-      } else if (line[0] == '}'){
-	token.value = str::lpop(line, 1);
-	token.type = Token::Type::Close_curl;
-	line = str::lremove(line, 1);
-	res.push_back(token);
-      } else if (line[0] == '='){
-	token.value = str::lpop(line, 1);
-	token.type = Token::Type::Equal;
-	line = str::lremove(line, 1);
-	res.push_back(token);
-      } else if (line[0] == ' '){
-	line = str::lremove(line, 1);
-	col++;
-      } else if (line[0] == '\n'){
-	line = str::lremove(line, 1);
-	col = 1;
-      } else if (line[0] == '"'){
-	// parse opening "
-	token.value = str::lpop(line, 1);
-	token.type = Token::Type::D_quote;
-	token.loc.col = col;
-	line = str::lremove(line, 1);
-	res.push_back(token);
-	col++;
-
-	// parse string
-	token.value = str::lpop_until(line, [](const char& ch) { return ch == '"'; });
-	token.loc.col = col;
-	token.type = Token::Type::String;
-	line = str::lremove(line, token.value.size());
-	res.push_back(token);
-	col += int(token.value.size());
-
-	// parse closing "
-	token.value = str::lpop(line, 1);
-	token.loc.col = col;
-	token.type = Token::Type::D_quote;
-	line = str::lremove(line, 1);
-	res.push_back(token);
-	col++;
-      } else if (line[0] == '\''){
-	// parse opening quote
-	token.value = str::lpop(line, 1);
-	token.loc.col = col;
-	token.type = Token::Type::Quote;
-	line = str::lremove(line, token.value.size());
-	res.push_back(token);
-	col++;
-
-	// parse char
-	token.value = str::lpop(line, 1);
-	token.loc.col = col;
-	token.type = Token::Type::Char;
-	line = str::lremove(line, token.value.size());
-	res.push_back(token);
-	col++;
-
-	// parse closing quote
-	token.value = str::lpop(line, 1);
-	token.loc.col = col;
-	token.type = Token::Type::Quote;
-	line = str::lremove(line, token.value.size());
-	res.push_back(token);
-	col++;
-      } else if (line[0] == ':'){
-	token.value = str::lpop(line, 1);
-	token.type = Token::Type::Colon;
-	line = str::lremove(line, token.value.size());
-	res.push_back(token);	
-      } else {
-	fprint(std::cerr, "ERROR: Cannot parse `{}`\n", line[0]);
-	exit(1);
-      }
-      if (token.type != Token::Type::D_quote &&
-	  token.type != Token::Type::Quote)
-	col += int(token.value.size());
-    }
-    row++;  
+// Decodes the character at src[i] and sets `len` to its size in bytes.
+// Sources are validated before they are lexed; a truncated sequence decodes
+// as U+FFFD with a length of 1.
+constexpr char32_t decode_utf8(std::string_view src, size_t i, size_t& len){
+  unsigned char c = src[i];
+  len = c < 0x80 ? 1 : c < 0xE0 ? 2 : c < 0xF0 ? 3 : 4;
+  if (len == 1) return c;
+  if (i + len > src.size()){
+    len = 1;
+    return 0xFFFD;
   }
+  char32_t cp = c & (0x7F >> len);
+  for (size_t k = 1; k < len; ++k) cp = (cp << 6) | ((unsigned char)(src[i+k]) & 0x3F);
+  return cp;
+}
 
-  return res;
+// Size of the identifier character at src[i], 0 if there is none. An
+// identifier starts with a letter, `_` or an XID_Start character and goes on
+// with letters, digits, `_` and XID_Continue characters.
+constexpr size_t ident_char(std::string_view src, size_t i, bool first){
+  unsigned char c = src[i];
+  if (c < 0x80) return lex_isalpha(char(c)) || c == '_' || (!first && lex_isdigit(char(c))) ? 1 : 0;
+  size_t len = 0;
+  char32_t cp = decode_utf8(src, i, len);
+  return (first ? xid_start(cp) : xid_continue(cp)) ? len : 0;
 }
 
-enum class Keyword {
-  Func
-};
+// Finds the `}` matching the `{` at src[open], skipping string and char
+// literals; returns its index or npos. Counts the newlines it passes in
+// `newlines` and remembers the last one in `last_newline`. At run time the
+// scan looks at 16 bytes at a time and only stops on `{`, `}`, quotes and
+// newlines.
+constexpr size_t skip_body(std::string_view src, size_t open, int& newlines, size_t& last_newline){
+  int depth = 0;
+  size_t i = open;
+  while (i < src.size()){
+#ifdef HASH_SSE2
+    if (!std::is_constant_evaluated() && i + 16 <= src.size()){
+      __m128i chunk = _mm_loadu_si128((const __m128i*)(src.data() + i));
+      __m128i hits = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, _mm_set1_epi8('{')),
+					       _mm_cmpeq_epi8(chunk, _mm_set1_epi8('}'))),
+				  _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, _mm_set1_epi8('"')),
+							    _mm_cmpeq_epi8(chunk, _mm_set1_epi8('\''))),
+					       _mm_cmpeq_epi8(chunk, _mm_set1_epi8('\n'))));
+      unsigned mask = unsigned(_mm_movemask_epi8(hits));
+      if (mask == 0){
+	i += 16;
+	continue;
+      }
+      i += size_t(std::countr_zero(mask));
+    }
+#endif
+    char c = src[i];
+    if (c == '{'){
+      depth++;
+    } else if (c == '}'){
+      if (--depth == 0) return i;
+    } else if (c == '\n'){
+      newlines++;
+      last_newline = i;
+    } else if (c == '"'){
+      size_t close = src.find_first_of("\"\n", i + 1);
+      // an unterminated string is left for the lexer to report when the body is lexed
+      if (close != std::string_view::npos && src[close] == '"') i = close;
+    } else if (c == '\''){
+      if (i + 2 < src.size() && src[i+2] == '\'') i += 2;
+    }
+    i++;
+  }
+  return std::string_view::npos;
+}
 
+// Number literals:
+//   123  1_000_000            Number
+//   0xFF  0b1010  0o777       Number, in base 16, 2 and 8
+//   1.5  2e10  6.022_140e+23  Float
+// `_` may only stand between two digits. scan_number() checks the syntax
+// while lexing; number_value() turns the accepted text into its binary value
+// when the token is made.
 
-struct Value {
-  enum class Type {
-    Int,
-    Float,
-    Ptr,
-    Char,
-    Str,
-    Bool,
-    Count
-  } type;
+// Index of the first byte at or after src[i] that is not a decimal digit.
+// At run time 16 bytes are classified at once.
+constexpr size_t digit_run(std::string_view src, size_t i){
+  while (i < src.size()){
+#ifdef HASH_SSE2
+    if (!std::is_constant_evaluated() && i + 16 <= src.size()){
+      __m128i chunk = _mm_loadu_si128((const __m128i*)(src.data() + i));
+      __m128i digits = _mm_and_si128(_mm_cmpgt_epi8(chunk, _mm_set1_epi8('0' - 1)),
+				     _mm_cmplt_epi8(chunk, _mm_set1_epi8('9' + 1)));
+      unsigned other = ~unsigned(_mm_movemask_epi8(digits)) & 0xFFFF;
+      if (other == 0){
+	i += 16;
+	continue;
+      }
+      return i + size_t(std::countr_zero(other));
+    }
+#endif
+    if (!lex_isdigit(src[i])) return i;
+    i++;
+  }
+  return i;
+}
 
-  static inline std::unordered_map<std::string, Type> type_as_name = {
-    {"int", Type::Int},
-    {"float", Type::Float},
-    {"ptr", Type::Ptr},
-    {"char", Type::Char},
-    {"str", Type::Str},
-    {"bool", Type::Bool},    
+// Scans the number literal at src[i], which starts with a digit, and moves
+// `i` past it. Sets `type` to Number or Float. Returns what is wrong with
+// the literal, or nullptr.
+constexpr const char* scan_number(std::string_view src, size_t& i, Token::Type& type){
+  auto at = [&](size_t k){ return k < src.size() ? src[k] : '\0'; };
+  int base = 10;
+  if (src[i] == '0'){
+    char prefix = char(at(i + 1) | 0x20);
+    base = prefix == 'x' ? 16 : prefix == 'b' ? 2 : prefix == 'o' ? 8 : 10;
+  }
+  auto is_digit = [&](char c){
+    if (base == 16) return lex_isdigit(c) || (char(c | 0x20) >= 'a' && char(c | 0x20) <= 'f');
+    return c >= '0' && c < char('0' + base);
+  };
+  // digits of `base`, with a `_` between two of them
+  auto digits = [&]() -> const char* {
+    size_t start = i;
+    while (true){
+      if (base == 10) i = digit_run(src, i);
+      else while (is_digit(at(i))) i++;
+      if (at(i) != '_') break;
+      if (i == start || !is_digit(at(i + 1))) return "`_` must stand between two digits";
+      i++;
+    }
+    return i == start ? "Expected a digit after the base prefix" : nullptr;
   };
 
-  static bool is_valid_type(const std::string& n){
-    return Value::type_as_name.contains(n);
+  type = Token::Type::Number;
+  const char* err = nullptr;
+  if (base != 10){
+    i += 2;
+    err = digits();
+  } else {
+    err = digits();
+    if (!err && at(i) == '.' && lex_isdigit(at(i + 1))){
+      type = Token::Type::Float;
+      i++;
+      err = digits();
+    }
+    if (!err && char(at(i) | 0x20) == 'e'){
+      size_t k = i + 1;
+      if (at(k) == '+' || at(k) == '-') k++;
+      if (!lex_isdigit(at(k))) return "Expected digits in the exponent";
+      type = Token::Type::Float;
+      i = k;
+      err = digits();
+    }
   }
+  if (!err && i < src.size() && ident_char(src, i, false)) err = "Invalid character in number literal";
+  return err;
+}
 
-};
-
-struct Block {
-  std::vector<Token> _tokens;
-
-  void collect_values(Token& curl_token, Tokens& tokens){
-    Option<Token> T;
-    do {
-      T = pop_token(tokens);
-      if (!T) {
-	compiler_error(curl_token, "Unclosed Function body");
-      }
-      Token token = T.unwrap();
-      print("Collected: `{}`\n", token.as_str());
-      if (token.type == Token::Type::Close_curl){
-	break;
-      } else {
-	_tokens.push_back(token);
-      }
-    } while (T);
+// The value of the 8 ASCII digits at p, computed in parallel within one
+// 64-bit word: every step sums adjacent groups of digits, weighting the
+// left group (Lemire, "Fast integer parsing").
+inline uint32_t eight_digits(const char* p){
+  uint64_t v = 0;
+  if constexpr (std::endian::native == std::endian::little){
+    std::memcpy(&v, p, 8);
+  } else {
+    for (int k = 7; k >= 0; --k) v = (v << 8) | uint8_t(p[k]);
   }
-};
-
+  v -= 0x3030303030303030;
+  v = v * 10 + (v >> 8);
+  v = ((v & 0x000000FF000000FF) * (100 + (1000000ull << 32)) + ((v >> 16) & 0x000000FF000000FF) * (1 + (10000ull << 32))) >> 32;
+  return uint32_t(v);
+}
 
-struct Function {
-  std::string name;
-  std::vector<Value> args;
-  Block block;
-  Value return_value;
-  Token token;
-};
+// A Float of at most 2^53 significand and a power of ten within 10^±22, at
+// build time: both are exact doubles, so one multiplication or division
+// rounds correctly (Clinger's fast path). Other literals fail the build.
+constexpr const char* static_float_value(std::string_view text, int64_t& bits){
+  uint64_t w = 0;
+  int64_t exp10 = 0;
+  size_t i = 0;
+  bool fraction = false;
+  int zeros = 0; // trailing zeros not yet in `w`
+  for (; i < text.size() && char(text[i] | 0x20) != 'e'; ++i){
+    if (text[i] == '.'){
+      fraction = true;
+      continue;
+    }
+    exp10 -= fraction;
+    uint64_t d = uint64_t(text[i] - '0');
+    if (d == 0){
+      zeros++;
+      continue;
+    }
+    for (; zeros > 0; --zeros){
+      if (w > (uint64_t(1) << 53) / 10) return "has too many digits to convert while building the compiler";
+      w *= 10;
+    }
+    if (w > ((uint64_t(1) << 53) - d) / 10) return "has too many digits to convert while building the compiler";
+    w = w * 10 + d;
+  }
+  exp10 += zeros;
+  if (i < text.size()){
+    i++;
+    bool negative = text[i] == '-';
+    if (text[i] == '+' || text[i] == '-') i++;
+    int64_t e = 0;
+    for (; i < text.size() && e < 1000; ++i) e = e * 10 + (text[i] - '0');
+    exp10 += negative ? -e : e;
+  }
+  if (w == 0) exp10 = 0;
+  if (exp10 > 22 || exp10 < -22) return "is too large or too small to convert while building the compiler";
+  double pow10 = 1;
+  for (int64_t k = 0; k < (exp10 < 0 ? -exp10 : exp10); ++k) pow10 *= 10;
+  double d = exp10 < 0 ? double(w) / pow10 : double(w) * pow10;
+  bits = std::bit_cast<int64_t>(d);
+  return nullptr;
+}
 
-std::vector<Function> functions;
+// Converts the text of a literal that scan_number() accepted as `type` into
+// `bits`: the value of a Number, the bit pattern of a Float's double.
+// Returns what is wrong with it, or nullptr. Also runs while the compiler is
+// built, for the embedded sources.
+constexpr const char* number_value(std::string_view text, Token::Type type, int64_t& bits){
+  char buf[64]{};
+  std::string long_buf;
+  if (text.find('_') != std::string_view::npos){
+    char* out = buf;
+    if (text.size() > sizeof(buf)){
+      long_buf.resize(text.size());
+      out = long_buf.data();
+    }
+    size_t n = 0;
+    for (char c : text){
+      if (c != '_') out[n++] = c;
+    }
+    text = std::string_view(out, n);
+  }
 
-static std::unordered_map<std::string, Keyword> keywords = {
-  {"func",  Keyword::Func},
-};
+  if (type == Token::Type::Float){
+    if (std::is_constant_evaluated()) return static_float_value(text, bits);
+    double d = 0;
+    auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), d);
+    if (ec != std::errc()) return "is out of range of `float`";
+    bits = std::bit_cast<int64_t>(d);
+    return nullptr;
+  }
 
-bool is_keyword(const std::string& name){
-  return keywords.contains(name);
+  int base = 10;
+  if (text.size() > 2 && text[0] == '0'){
+    char prefix = char(text[1] | 0x20);
+    base = prefix == 'x' ? 16 : prefix == 'b' ? 2 : prefix == 'o' ? 8 : 10;
+    if (base != 10) text.remove_prefix(2);
+  }
+  uint64_t v = 0;
+  if (std::is_constant_evaluated()){
+    for (char c : text){
+      uint64_t d = lex_isdigit(c) ? uint64_t(c - '0') : uint64_t((c | 0x20) - 'a' + 10);
+      if (v > (UINT64_MAX - d) / uint64_t(base)) return "does not fit in `int`";
+      v = v * uint64_t(base) + d;
+    }
+  } else if (base == 10){
+    while (text.size() > 1 && text[0] == '0') text.remove_prefix(1);
+    if (text.size() > 19) return "does not fit in `int`";
+    size_t i = 0;
+    for (; i + 8 <= text.size(); i += 8) v = v * 100000000 + eight_digits(text.data() + i);
+    for (; i < text.size(); ++i) v = v * 10 + uint64_t(text[i] - '0');
+  } else {
+    auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), v, base);
+    if (ec != std::errc()) return "does not fit in `int`";
+  }
+  if (v > uint64_t(INT64_MAX)) return "does not fit in `int`";
+  bits = int64_t(v);
+  return nullptr;
 }
 
+// Lexes `src` into `sink`. The first byte of `src` sits at `row`:`first_col`;
+// later lines start at column 1. Strings and chars never span lines, so any
+// line start is a safe place to start lexing. With `skip_bodies`, `{ ... }`
+// bodies are not lexed: only their Open_curl and Close_curl are produced.
+// Returns the number of newlines consumed.
+template <typename Sink>
+constexpr int lex_core(std::string_view src, int first_col, int row, bool skip_bodies, Sink& sink){
+  size_t i = 0;
+  size_t line_start = 0;
+  int newlines = 0;
+  size_t line_end = src.find('\n');
+  if (line_end == std::string_view::npos) line_end = src.size();
 
+  auto next_line = [&](size_t newline){
+    row++;
+    newlines++;
+    line_start = newline + 1;
+    first_col = 1;
+    line_end = src.find('\n', line_start);
+    if (line_end == std::string_view::npos) line_end = src.size();
+  };
 
-int parse_arguments(Token& open_paren, Tokens& tokens){
-  Option<Token> T;
-  std::vector<std::string> declared_arguments;
-  int arg_count = 0;
-  bool name_handled = false;
-  
-  do {
-    T = pop_token(tokens);
-    if (!T){
-      compiler_error(open_paren, "Unclosed parenthesis");
+  while (i < src.size()){
+    if (i == line_end){
+      next_line(i);
+      i++;
+      continue;
     }
-    Token t = T.unwrap();
-    
-    if (t.type == Token::Type::Name){
-      bool found = false;
-      for (auto& a : declared_arguments){ if (a == t.value) { found = true; break; } }
-      if (!found){ declared_arguments.push_back(t.value); }
-      name_handled = true;
-    } else if (t.type == Token::Type::Close_paren){
-      break;
-    } else if (t.type == Token::Type::Colon){
-      if (!name_handled){
-	compiler_error(t, "Argument name is not provided");
-      }
-      name_handled=false;
-      T = pop_token(tokens);
-      if (!T){
-	// TODO: pass the token of the function
-	compiler_error(t, "Unfinished Function declaration");
+    int col = first_col + int(i - line_start);
+    char c = src[i];
+    if (size_t n = ident_char(src, i, true)){
+      size_t begin = i;
+      i += n;
+      while (i < line_end && (n = ident_char(src, i, false))) i += n;
+      sink.push(Token::Type::Name, begin, i, row, col);
+    } else if (lex_isdigit(c)){
+      size_t begin = i;
+      Token::Type type = Token::Type::Number;
+      if (const char* err = scan_number(src, i, type)){
+	sink.error(row, col, err);
+      }
+      sink.push(type, begin, i, row, col);
+    } else if (c == '-' && i + 1 < line_end && src[i+1] == '>'){
+      sink.push(Token::Type::Returner, i, i + 2, row, col);
+      i += 2;
+    } else if (c == ' ' || c == '\r'){
+      i++;
+    } else if (c == '"'){
+      size_t close = src.find('"', i + 1);
+      if (close == std::string_view::npos || close > line_end){
+	sink.error(row, col, "Unterminated string literal");
+      }
+      sink.push(Token::Type::D_quote, i, i + 1, row, col);
+      sink.push(Token::Type::String, i + 1, close, row, col + 1);
+      sink.push(Token::Type::D_quote, close, close + 1, row, first_col + int(close - line_start));
+      i = close + 1;
+    } else if (c == '\''){
+      if (i + 2 >= line_end || src[i+2] != '\''){
+	sink.error(row, col, "Unterminated character literal");
       }
-      t = T.unwrap();
-      if (!Value::is_valid_type(t.value)) {
-	compiler_error(t, "Unkown type `{}`", t.value);
+      sink.push(Token::Type::Quote, i, i + 1, row, col);
+      sink.push(Token::Type::Char, i + 1, i + 2, row, col + 1);
+      sink.push(Token::Type::Quote, i + 2, i + 3, row, col + 2);
+      i += 3;
+    } else if (c == '{' && skip_bodies){
+      sink.push(Token::Type::Open_curl, i, i + 1, row, col);
+      int body_newlines = 0;
+      size_t last_newline = std::string_view::npos;
+      size_t close = skip_body(src, i, body_newlines, last_newline);
+      if (close == std::string_view::npos){
+	sink.error(row, col, "Unclosed Function body");
       }
-    } else if (t.type == Token::Type::Comma){
-      arg_count++;
+      if (body_newlines > 0){
+	row += body_newlines - 1;
+	newlines += body_newlines - 1;
+	next_line(last_newline);
+      }
+      sink.push(Token::Type::Close_curl, close, close + 1, row, first_col + int(close - line_start));
+      i = close + 1;
     } else {
-      compiler_error(t, "`{}` is unexpected here", t.value);
+      Token::Type type = Token::Type::Name;
+      switch (c){
+      case '(': type = Token::Type::Open_paren;  break;
+      case ')': type = Token::Type::Close_paren; break;
+      case ',': type = Token::Type::Comma;       break;
+      case ';': type = Token::Type::Semi_colon;  break;
+      case ':': type = Token::Type::Colon;       break;
+      case '-': type = Token::Type::Minus;       break;
+      case '+': type = Token::Type::Plus;        break;
+      case '*': type = Token::Type::Mult;        break;
+      case '/': type = Token::Type::Div;         break;
+      case '%': type = Token::Type::Mod;         break;
+      case '{': type = Token::Type::Open_curl;   break;
+      case '}': type = Token::Type::Close_curl;  break;
+      case '=': type = Token::Type::Equal;       break;
+      default: {
+	size_t len = 0;
+	decode_utf8(src, i, len);
+	sink.unknown(src.substr(i, len));
+      } break;
+      }
+      sink.push(type, i, i + 1, row, col);
+      i++;
     }
-    
-  } while (T);
-  return arg_count;
+  }
+  return newlines;
 }
 
-void parse_tokens(Tokens& tokens){
-  Option<Token> T;
-  Option<Token> prev;
+// Lexes `src` into `res`. The first byte of `src` sits at `start` in the file
+// and at byte `offset` of its source text. With `skip_bodies`, Block::tokens()
+// lexes the skipped bodies when they are needed.
+int lex_lines(std::string_view src, const Loc& start, size_t offset, Tokens& res, bool skip_bodies = false){
+  struct Sink {
+    std::string_view src;
+    const Loc& start;
+    size_t offset;
+    Tokens& res;
 
-  Function current_func;
-  bool declaring_func=false;
-  
-  do {
-    T = pop_token(tokens);
-    Token token = T.unwrap();
-    
-    switch (token.type){
-    case Token::Type::Name: {
-      if (is_keyword(token.value)){
-	Keyword k = keywords[token.value];
-	switch(k){
-	case Keyword::Func:{
-	  
-	} break;
-	default:{
-	  UNREACHABLE();
-	} break;
-	}
-      }
-    } break;
-    case Token::Type::Number: {
-      UNIMPLEMENTED();
-    } break;
-    case Token::Type::Open_paren: {
-      declaring_func = true;
-      // TODO: check if the previous token was a name
-      if (!prev) {
-	compiler_error(token, "Function has no name");
-      }
-      
-      current_func.name = prev.unwrap().value;
-      int arg_count = parse_arguments(token, tokens);
-      current_func.args.resize(arg_count);
-      current_func.token = prev.unwrap();
-      // TODO: actually get the function args somehow
-      
-    } break;
-    case Token::Type::Close_paren: {
-      UNIMPLEMENTED();
-    } break;
-    case Token::Type::Semi_colon: {
-      UNIMPLEMENTED();
-    } break;
-    case Token::Type::Colon: {
-      UNIMPLEMENTED();
-    } break;
-    case Token::Type::Comma: {
-      UNIMPLEMENTED();
-    } break;
-    case Token::Type::Minus: {
-      UNIMPLEMENTED();
-    } break;
-    case Token::Type::Plus: {
-      UNIMPLEMENTED();
-    } break;
-    case Token::Type::Mult: {
-      UNIMPLEMENTED();
-    } break;
-    case Token::Type::Div: {
-      UNIMPLEMENTED();
-    } break;
-    case Token::Type::Mod: {
-      UNIMPLEMENTED();
-    } break;
-    case Token::Type::Equal: {
-      UNIMPLEMENTED();
-    } break;
-    case Token::Type::Returner: {
-      T = pop_token(tokens);
-      if (!T){
-	// TODO: pass the token of the function
-	compiler_error(token, "Unfinished Function declaration");
+    void push(Token::Type type, size_t begin, size_t end, int row, int col){
+      Token* t;
+      {
+	MEM_SITE("Tokens");
+	t = &res.emplace_back();
       }
-      token = T.unwrap();
-      if (!Value::is_valid_type(token.value)) {
-	compiler_error(token, "Unkown type `{}`", token.value);
+      Token& token = *t;
+      token.type = type;
+      {
+	MEM_SITE("Token::value");
+	token.value.assign(src.data() + begin, end - begin);
       }
-    } break;
-    case Token::Type::Open_curl: {
-      if (!declaring_func){
-	compiler_error(token, "`{}` is unexpected here", token.value);
+      MEM_SITE("Loc::file_path");
+      token.loc.file_path = start.file_path;
+      token.loc.col = col;
+      token.loc.row = row;
+      token.offset = offset + begin;
+      if (type == Token::Type::Name) token.atom = atoms.intern(src.substr(begin, end - begin));
+      if (type == Token::Type::Number || type == Token::Type::Float){
+	if (const char* err = number_value(src.substr(begin, end - begin), type, token.number)){
+	  fatal_error(FMT("{}: ERROR: `{}` {}\n", token.loc.as_str(), token.value, err));
+	}
       }
-      
-      // collect values of the func block
-      current_func.block.collect_values(token, tokens);
-    } break;
-    case Token::Type::Close_curl: {
-      UNIMPLEMENTED();
-    } break;
-    case Token::Type::D_quote: {
-      UNIMPLEMENTED();
-    } break;
-    case Token::Type::Quote: {
-      UNIMPLEMENTED();
-    } break;
-    case Token::Type::String: {
-      UNIMPLEMENTED();
-    } break;
-    case Token::Type::Char: {
-      UNIMPLEMENTED();
-    } break;
-    default: {
-      UNREACHABLE();
-    } break;
     }
-
-    prev = T;
-  } while (T);
+    [[noreturn]] void error(int row, int col, const char* message){
+      fatal_error(FMT("{}: ERROR: {}\n", Loc{col, row, start.file_path}.as_str(), message));
+    }
+    [[noreturn]] void unknown(std::string_view c){
+      fatal_error(FMT("ERROR: Cannot parse `{}`\n", c));
+    }
+  } sink{src, start, offset, res};
+  return lex_core(src, start.col, start.row, skip_bodies, sink);
 }
 
-void dump_tokens(Tokens& tokens){
-  print("Tokens:\n");
-  for (auto& token : tokens){
-    print("{}:{}\n", token.loc.as_str(), token.as_str());
+// UTF-8 --------------------------------------------------
+// Sources are validated as UTF-8 once, before lexing, so the lexer can decode
+// identifiers without checking them. Blocks of pure ASCII only cost a
+// movemask. Other blocks run the lookup algorithm of simdutf (Keiser and
+// Lemire, "Validating UTF-8 in less than one instruction per byte"): three
+// nibble-indexed table lookups classify every pair of adjacent bytes, and a
+// saturating subtract finds the continuation bytes a 3- or 4-byte lead
+// needs. The first block with an error is rescanned by the scalar validator
+// to find the exact offset.
+
+// Offset of the first invalid sequence at or after src[i], or npos.
+size_t utf8_error_scalar(std::string_view src, size_t i){
+  while (i < src.size()){
+#ifdef HASH_SSE2
+    if (i + 16 <= src.size() && _mm_movemask_epi8(_mm_loadu_si128((const __m128i*)(src.data() + i))) == 0){
+      i += 16;
+      continue;
+    }
+#endif
+    unsigned char c = src[i];
+    if (c < 0x80){
+      i++;
+      continue;
+    }
+    size_t len;
+    char32_t min;
+    if ((c & 0xE0) == 0xC0){ len = 2; min = 0x80; }
+    else if ((c & 0xF0) == 0xE0){ len = 3; min = 0x800; }
+    else if ((c & 0xF8) == 0xF0){ len = 4; min = 0x10000; }
+    else return i;
+    if (i + len > src.size()) return i;
+    char32_t cp = c & (0x7F >> len);
+    for (size_t k = 1; k < len; ++k){
+      unsigned char cc = src[i+k];
+      if ((cc & 0xC0) != 0x80) return i;
+      cp = (cp << 6) | (cc & 0x3F);
+    }
+    if (cp < min || cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF)) return i;
+    i += len;
   }
+  return std::string_view::npos;
 }
 
-int main(int argc, char *argv[]) {
-  // for (size_t i = 0; i <= 127; ++i){
-  //   print("`{}` {}\n", char(i), (ch::isdigit(char(i)) ? "is digit" : ""));
-  // }
+#if defined(STDCPP_X86)
+// The previous N bytes of the stream for every byte of `in`.
+template <int N>
+STDCPP_TARGET_AVX2 static __m256i utf8_prev(__m256i in, __m256i prev){
+  return _mm256_alignr_epi8(in, _mm256_permute2x128_si256(prev, in, 0x21), 16 - N);
+}
 
-  // return 0;
+STDCPP_TARGET_AVX2 static __m256i utf8_block_errors(__m256i in, __m256i prev){
+  enum : uint8_t {
+    TOO_SHORT = 1 << 0, // a lead or ASCII where a continuation is needed
+    TOO_LONG = 1 << 1,  // a continuation after ASCII
+    OVERLONG_3 = 1 << 2,
+    TOO_LARGE = 1 << 3,
+    SURROGATE = 1 << 4,
+    OVERLONG_2 = 1 << 5,
+    TOO_LARGE_1000 = 1 << 6,
+    OVERLONG_4 = 1 << 6,
+    TWO_CONTS = 1 << 7, // two continuations, fine only after a 3- or 4-byte lead
+    CARRY = TOO_SHORT | TOO_LONG | TWO_CONTS,
+  };
+  const __m256i byte_1_high = _mm256_setr_epi8(
+    TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+    TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS,
+    TOO_SHORT | OVERLONG_2, TOO_SHORT, TOO_SHORT | OVERLONG_3 | SURROGATE,
+    TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4,
+    TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+    TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS,
+    TOO_SHORT | OVERLONG_2, TOO_SHORT, TOO_SHORT | OVERLONG_3 | SURROGATE,
+    TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4);
+  const __m256i byte_1_low = _mm256_setr_epi8(
+    CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4, CARRY | OVERLONG_2, CARRY, CARRY,
+    CARRY | TOO_LARGE, CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE, CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4, CARRY | OVERLONG_2, CARRY, CARRY,
+    CARRY | TOO_LARGE, CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE, CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000);
+  const __m256i byte_2_high = _mm256_setr_epi8(
+    TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000 | OVERLONG_4,
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE,
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+    TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+    TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000 | OVERLONG_4,
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE,
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+    TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT);
+  const __m256i low_nibble = _mm256_set1_epi8(0x0F);
 
-  Tokens tokens = parse_source_file("main.hash");
-  // dump_tokens(tokens);
-  parse_tokens(tokens);
+  __m256i prev1 = utf8_prev<1>(in, prev);
+  __m256i special = _mm256_and_si256(
+    _mm256_and_si256(_mm256_shuffle_epi8(byte_1_high, _mm256_and_si256(_mm256_srli_epi16(prev1, 4), low_nibble)),
+		     _mm256_shuffle_epi8(byte_1_low, _mm256_and_si256(prev1, low_nibble))),
+    _mm256_shuffle_epi8(byte_2_high, _mm256_and_si256(_mm256_srli_epi16(in, 4), low_nibble)));
+  // only 111_____ and 1111____ come out >= 0x80
+  __m256i third = _mm256_subs_epu8(utf8_prev<2>(in, prev), _mm256_set1_epi8(char(0xE0 - 0x80)));
+  __m256i fourth = _mm256_subs_epu8(utf8_prev<3>(in, prev), _mm256_set1_epi8(char(0xF0 - 0x80)));
+  __m256i must_be_cont = _mm256_and_si256(_mm256_or_si256(third, fourth), _mm256_set1_epi8(char(0x80)));
+  return _mm256_xor_si256(must_be_cont, special);
+}
+
+// Non-zero where a block ends inside a multi-byte sequence.
+STDCPP_TARGET_AVX2 static __m256i utf8_incomplete(__m256i in){
+  const __m256i max = _mm256_setr_epi8(
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    char(0xF0 - 1), char(0xE0 - 1), char(0xC0 - 1));
+  return _mm256_subs_epu8(in, max);
+}
+
+STDCPP_TARGET_AVX2 static size_t utf8_error_avx2(std::string_view src){
+  __m256i prev = _mm256_setzero_si256();
+  __m256i incomplete = _mm256_setzero_si256();
+  size_t i = 0;
+  // the last block is the tail padded with spaces, possibly all padding, so
+  // a sequence cut off by the end of the source is caught there
+  while (true){
+    bool tail = i + 32 > src.size();
+    __m256i in;
+    if (tail){
+      alignas(32) char buf[32];
+      std::memset(buf, ' ', sizeof(buf));
+      std::memcpy(buf, src.data() + i, src.size() - i);
+      in = _mm256_load_si256((const __m256i*)buf);
+    } else {
+      in = _mm256_loadu_si256((const __m256i*)(src.data() + i));
+    }
+    __m256i error;
+    if (_mm256_movemask_epi8(in) == 0){
+      error = incomplete;
+      incomplete = _mm256_setzero_si256();
+    } else {
+      error = utf8_block_errors(in, prev);
+      incomplete = utf8_incomplete(in);
+    }
+    if (!_mm256_testz_si256(error, error)){
+      // the error is in this block or in a sequence the previous block began
+      size_t from = i > 3 ? i - 3 : 0;
+      while (from > 0 && (uint8_t(src[from]) & 0xC0) == 0x80) from--;
+      size_t at = utf8_error_scalar(src, from);
+      return at == std::string_view::npos ? i : at;
+    }
+    if (tail) return std::string_view::npos;
+    prev = in;
+    i += 32;
+  }
+}
+#endif
+
+// Offset of the first invalid UTF-8 sequence in `src`, or npos.
+size_t utf8_error(std::string_view src){
+#if defined(STDCPP_X86)
+  static const bool avx2 = math::has_avx2();
+  if (avx2) return utf8_error_avx2(src);
+#endif
+  return utf8_error_scalar(src, 0);
+}
+
+// Reports the first invalid UTF-8 sequence in `src`, which starts at the
+// beginning of line `start.row`.
+void check_utf8(std::string_view src, const Loc& start){
+  size_t bad = utf8_error(src);
+  if (bad == std::string_view::npos) return;
+  size_t line_start = src.rfind('\n', bad);
+  line_start = line_start == std::string_view::npos ? 0 : line_start + 1;
+  int row = start.row + int(std::count(src.begin(), src.begin() + line_start, '\n'));
+  Loc loc{int(bad - line_start) + 1, row, start.file_path};
+  fatal_error(FMT("{}: ERROR: Invalid UTF-8\n", loc.as_str()));
+}
+
+// Embedded sources --------------------------------------------------
+// Tokens of a source that is compiled into the binary, produced by
+// lex_static() during the C++ build. A lex error in the source, or a number
+// literal number_value() rejects, fails the build: the sink's error() is not
+// constexpr, so reaching it stops constant evaluation at the offending row
+// and column.
+struct Static_token {
+  Token::Type type;
+  uint32_t begin, end; // into the embedded source
+  int row, col;
+  int64_t number; // Token::number
+};
+
+template <size_t N>
+struct Static_tokens {
+  std::string_view src;
+  std::array<Static_token, N> tokens{};
+  size_t count{0};
+
+  constexpr void push(Token::Type type, size_t begin, size_t end, int row, int col){
+    int64_t number = 0;
+    if (type == Token::Type::Number || type == Token::Type::Float){
+      if (const char* err = number_value(src.substr(begin, end - begin), type, number)) error(row, col, err);
+    }
+    if (count < N) tokens[count] = {type, uint32_t(begin), uint32_t(end), row, col, number};
+    count++;
+  }
+  void error(int, int, const char*){ UNREACHABLE(); }
+  void unknown(std::string_view){ UNREACHABLE(); }
+};
+
+constexpr size_t count_static_tokens(std::string_view src){
+  Static_tokens<0> counter{src};
+  lex_core(src, 1, 1, false, counter);
+  return counter.count;
+}
+
+template <size_t N>
+constexpr Static_tokens<N> lex_static(std::string_view src){
+  Static_tokens<N> res{src};
+  lex_core(src, 1, 1, false, res);
+  return res;
+}
+
+// Worker threads shared by every parallel stage, started on first use. A
+// pool for `jobs` has `jobs` - 1 workers: the thread that waits on a stage
+// runs its tasks as well.
+std::unique_ptr<job::Pool> job_pool;
+
+job::Pool& workers(int jobs){
+  if (!job_pool || job_pool->size() != jobs) job_pool = std::make_unique<job::Pool>(jobs - 1);
+  return *job_pool;
+}
+
+#define LEX_CHUNKS_PER_JOB 4
+
+// Splits `src` into chunks at newlines and lexes them on the worker pool,
+// a few chunks per job so that threads that finish early steal the rest.
+// Each chunk is lexed with rows counted from 0; a prefix sum over the
+// per-chunk line counts then gives every chunk its first row, and the
+// chunks are moved into `res` in order, so the result matches lex_lines()
+// over the whole buffer exactly.
+void lex_parallel(std::string_view src, const std::string& file_path, int jobs, Tokens& res){
+  job::Pool& pool = workers(jobs);
+  int parts = jobs * LEX_CHUNKS_PER_JOB;
+  std::vector<std::string_view> chunks;
+  size_t begin = 0;
+  for (int j = 1; j <= parts && begin < src.size(); ++j){
+    size_t end = j == parts ? src.size() : std::max(begin, src.size() * j / parts);
+    end = src.find('\n', end);
+    end = end == std::string_view::npos ? src.size() : end + 1;
+    chunks.push_back(src.substr(begin, end - begin));
+    begin = end;
+  }
+
+  size_t n = chunks.size();
+  std::vector<Tokens> chunk_tokens(n);
+  std::vector<int> chunk_lines(n, 0);
+  std::vector<char> chunk_failed(n, 0);
+  job::parallel_for(pool, 0, n, [&](size_t first, size_t last){
+    bool fatal = errors_are_fatal;
+    errors_are_fatal = false;
+    for (size_t c = first; c < last; ++c){
+      try {
+	chunk_lines[c] = lex_lines(chunks[c], Loc{1, 0, file_path}, size_t(chunks[c].data() - src.data()), chunk_tokens[c]);
+      } catch (Compile_error&){
+	chunk_failed[c] = 1;
+      }
+    }
+    errors_are_fatal = fatal;
+  }, 1);
+
+  // relex the first failing chunk with its real rows to report the same
+  // error the serial lexer would
+  int first_row = 1;
+  for (size_t c = 0; c < n; ++c){
+    if (chunk_failed[c]){
+      Tokens scratch;
+      lex_lines(chunks[c], Loc{1, first_row, file_path}, size_t(chunks[c].data() - src.data()), scratch);
+      UNREACHABLE();
+    }
+    first_row += chunk_lines[c];
+  }
+
+  std::vector<int> chunk_row(n);
+  std::vector<size_t> first_token(n);
+  int row = 1;
+  size_t count = 0;
+  for (size_t c = 0; c < n; ++c){
+    chunk_row[c] = row;
+    first_token[c] = count;
+    row += chunk_lines[c];
+    count += chunk_tokens[c].size();
+  }
+
+  size_t base = res.size();
+  res.resize(base + count);
+  job::parallel_for(pool, 0, n, [&](size_t first, size_t last){
+    for (size_t c = first; c < last; ++c){
+      Token* out = res.data() + base + first_token[c];
+      for (auto& token : chunk_tokens[c]){
+	token.loc.row += chunk_row[c];
+	*out++ = std::move(token);
+      }
+      Tokens().swap(chunk_tokens[c]);
+    }
+  }, 1);
+}
+
+// Source text of every lexed file, by absolute path, so lazily skipped
+// function bodies can be lexed later. Token offsets index into these.
+std::unordered_map<std::string, std::shared_ptr<const std::string>> sources;
+
+// With `skip_bodies`, function bodies are lexed when they are needed, except
+// in files big enough for the parallel lexer, which lexes everything at once.
+Tokens parse_source_file(const std::string& filename, int jobs = 1, bool skip_bodies = false){
+  std::string file_ext = str::rpop_until(filename, '.');
+  if (file_ext != FILE_EXT){
+    fatal_error(FMT("ERROR: Hash source files must have the extension `{}`!\n", FILE_EXT));
+  }
+  mem::set_phase(mem::Phase::Read);
+  std::string file;
+  {
+    MEM_SITE("file::slurp_file");
+    file = file::slurp_file(filename);
+  }
+  Tokens res;
+  if (file.empty()){
+    print("WARNING: File {} is empty\n", filename);
+    return res;
+  }
+
+  // kept byte for byte, so token offsets are offsets into the file on disk,
+  // as an editor counts them; the lexer skips `\r` like a space
+  MEM_SITE("sources");
+  auto text = std::make_shared<const std::string>(std::move(file));
+  std::string_view src = *text;
+  std::string file_path = fs::absolute(fs::path(filename)).string();
+  sources[file_path] = text;
+  mem::set_phase(mem::Phase::Lex);
+
+  check_utf8(src, Loc{1, 1, file_path});
+  if (jobs > 1 && src.size() >= LEX_PARALLEL_MIN_SIZE){
+    lex_parallel(src, file_path, jobs, res);
+  } else {
+    lex_lines(src, Loc{1, 1, file_path}, 0, res, skip_bodies);
+  }
+  return res;
+}
+
+// Incremental relexing --------------------------------------------------
+// An editor sends every change as an edit of a byte range, and relex()
+// updates the tokens of the file instead of lexing all of it again. The
+// lexer carries no state from one line to the next (strings and chars never
+// span lines, and bodies are only skipped when asked to), so every line
+// start is a safe restart point and the old and new token streams line up
+// again at the first line start after the edit. Only the edited lines are
+// lexed. Edit_buffer keeps a file as pieces of whole lines whose tokens
+// count offsets and rows from the start of their piece, so the tokens after
+// the edit are shifted only up to the end of its piece, not to the end of
+// the file.
+
+// Replaces `removed` bytes at `offset` of `text` with `inserted` and updates
+// `tokens`, the fully lexed tokens of `text` (not skipping bodies), to
+// match. Token rows count from 0 at the first line of `text`, which is at
+// `start` in the file; errors are reported there. On an error `text` and
+// `tokens` are unchanged.
+void relex(Tokens& tokens, std::string& text, const Loc& start, size_t offset, size_t removed, std::string_view inserted){
+  std::string_view old = text;
+  size_t line_start = offset;
+  while (line_start > 0 && old[line_start - 1] != '\n') line_start--;
+  size_t old_end = old.find('\n', offset + removed);
+  old_end = old_end == std::string_view::npos ? old.size() : old_end + 1;
+
+  // the edited lines as they read after the edit
+  std::string lines;
+  lines.reserve(old_end - line_start - removed + inserted.size());
+  lines.append(old.substr(line_start, offset - line_start));
+  lines.append(inserted);
+  lines.append(old.substr(offset + removed, old_end - offset - removed));
+
+  auto before = [](const Token& token, size_t off){ return token.offset < off; };
+  auto first = std::lower_bound(tokens.begin(), tokens.end(), line_start, before);
+  auto last = std::lower_bound(first, tokens.end(), old_end, before);
+
+  // rows are counted from the last token before the edited lines
+  int row = 0;
+  size_t counted = 0;
+  if (first != tokens.begin()){
+    row = std::prev(first)->loc.row;
+    counted = std::prev(first)->offset;
+  }
+  row += int(std::count(old.begin() + counted, old.begin() + line_start, '\n'));
+
+  Loc lines_start{1, start.row + row, start.file_path};
+  check_utf8(lines, lines_start);
+  Tokens fresh;
+  lex_lines(lines, lines_start, line_start, fresh);
+  for (auto& token : fresh) token.loc.row -= start.row;
+
+  size_t shift = inserted.size() - removed; // wraps around for a shrinking edit
+  int row_shift = int(std::count(inserted.begin(), inserted.end(), '\n'))
+    - int(std::count(old.begin() + offset, old.begin() + offset + removed, '\n'));
+  if (shift != 0 || row_shift != 0){
+    for (auto it = last; it != tokens.end(); ++it){
+      it->offset += shift;
+      it->loc.row += row_shift;
+    }
+  }
+
+  size_t at = size_t(first - tokens.begin());
+  size_t stale = size_t(last - first);
+  size_t common = std::min(stale, fresh.size());
+  std::move(fresh.begin(), fresh.begin() + common, first);
+  if (stale > common){
+    tokens.erase(tokens.begin() + at + common, tokens.begin() + at + stale);
+  } else {
+    tokens.insert(tokens.begin() + at + common, std::make_move_iterator(fresh.begin() + common), std::make_move_iterator(fresh.end()));
+  }
+  text.replace(offset, removed, inserted);
+}
+
+#define EDIT_PIECE_SIZE 4096 // bytes an Edit_buffer piece is cut to; it is cut again at twice that
+
+// The text and the tokens of a file under edit, in pieces of whole lines.
+// Offsets index the file as it is on disk, as parse_source_file() reads it.
+// Pieces are cut where a line starts outside of any braces when there is
+// such a line nearby, so that they tend to hold whole functions.
+struct Edit_buffer {
+  struct Piece {
+    std::string text; // whole lines; only the last piece may end without a newline
+    Tokens tokens;    // offsets from the start of `text`, rows from 0 at its first line
+    int lines{0};     // newlines in `text`
+    int depth{0};     // how much deeper in braces `tokens` end than they start
+    bool lexed{true}; // false after an edit that did not lex: `tokens` are stale
+    uint64_t version{0}; // new whenever `text` changes, never reused
+
+    // Recounts what `text` and `tokens` give after they change.
+    void update(){
+      static uint64_t versions = 0;
+      lines = int(std::count(text.begin(), text.end(), '\n'));
+      depth = 0;
+      for (auto& token : tokens) depth += brace_depth(token);
+      version = ++versions;
+    }
+  };
+
+  static int brace_depth(const Token& token){
+    return token.type == Token::Type::Open_curl ? 1 : token.type == Token::Type::Close_curl ? -1 : 0;
+  }
+
+  std::string file_path;
+  std::vector<Piece> pieces;
+  size_t size{0};
+  // the piece of the last edit and where it starts: edits cluster, so the
+  // next one is found by walking from there
+  size_t cursor{0};
+  size_t cursor_offset{0};
+  int cursor_row{1};
+
+  // Cuts `text` into pieces of about EDIT_PIECE_SIZE bytes. `tokens` are
+  // those of `text`, their offsets counting from `offset` and rows from `row`.
+  static std::vector<Piece> cut(std::string_view text, Tokens tokens, size_t offset, int row, bool lexed){
+    std::vector<Piece> res;
+    size_t begin = 0;
+    size_t t = 0;
+    int depth = 0;
+    do {
+      size_t end = text.size();
+      if (end - begin > EDIT_PIECE_SIZE){
+	// the first line end past EDIT_PIECE_SIZE outside of braces, if one
+	// comes before twice that, else the first line end
+	size_t first = text.find('\n', begin + EDIT_PIECE_SIZE - 1);
+	size_t newline = first;
+	size_t u = t;
+	int d = depth;
+	while (newline != std::string_view::npos && newline - begin < 2 * EDIT_PIECE_SIZE){
+	  while (u < tokens.size() && tokens[u].offset - offset < newline) d += brace_depth(tokens[u++]);
+	  if (d == 0) break;
+	  newline = text.find('\n', newline + 1);
+	}
+	if (newline == std::string_view::npos || newline - begin >= 2 * EDIT_PIECE_SIZE) newline = first;
+	if (newline != std::string_view::npos) end = newline + 1;
+      }
+      Piece piece;
+      piece.text = text.substr(begin, end - begin);
+      piece.lexed = lexed;
+      while (t < tokens.size() && tokens[t].offset - offset < end){
+	Token& token = tokens[t++];
+	token.offset -= offset + begin;
+	token.loc.row -= row;
+	depth += brace_depth(token);
+	piece.tokens.push_back(std::move(token));
+      }
+      piece.update();
+      row += piece.lines;
+      begin = end;
+      res.push_back(std::move(piece));
+    } while (begin < text.size());
+    return res;
+  }
+
+  // Takes the text of `file_path` and its tokens as lex_lines() makes them.
+  // Without `lexed` the text did not lex, and the tokens are ignored.
+  void assign(const std::string& path, std::string_view text, Tokens tokens, bool lexed = true){
+    file_path = path;
+    pieces = cut(text, lexed ? std::move(tokens) : Tokens{}, 0, 1, lexed);
+    size = text.size();
+    cursor = 0;
+    cursor_offset = 0;
+    cursor_row = 1;
+  }
+
+  // Appends the piece after `i` to it.
+  void merge(size_t i){
+    Piece& piece = pieces[i];
+    Piece& next = pieces[i + 1];
+    for (auto& token : next.tokens){
+      token.offset += piece.text.size();
+      token.loc.row += piece.lines;
+      piece.tokens.push_back(std::move(token));
+    }
+    piece.text += next.text;
+    piece.lexed = piece.lexed && next.lexed;
+    piece.update();
+    pieces.erase(pieces.begin() + i + 1);
+  }
+
+  // Lexes a piece whose tokens are stale again, e.g. to report its error.
+  void lex_piece(Piece& piece, int row){
+    Loc start{1, row, file_path};
+    Tokens tokens;
+    check_utf8(piece.text, start);
+    lex_lines(piece.text, start, 0, tokens);
+    for (auto& token : tokens) token.loc.row -= row;
+    piece.tokens = std::move(tokens);
+    piece.lexed = true;
+    piece.update();
+  }
+
+  // Replaces `removed` bytes at `offset` with `inserted`, relexing the
+  // edited lines. The text takes the edit even when it does not lex, since
+  // the editor has made it, and the error is thrown; its piece is lexed
+  // whole by the next edit of it or by tokens().
+  void edit(size_t offset, size_t removed, std::string_view inserted){
+    if (offset > size || removed > size - offset){
+      fatal_error(FMT("ERROR: Edit of {} bytes at offset {} is out of range of `{}` ({} bytes)\n", removed, offset, file_path, size));
+    }
+    while (cursor > 0 && offset < cursor_offset){
+      cursor--;
+      cursor_offset -= pieces[cursor].text.size();
+      cursor_row -= pieces[cursor].lines;
+    }
+    while (cursor + 1 < pieces.size() && offset >= cursor_offset + pieces[cursor].text.size()){
+      cursor_offset += pieces[cursor].text.size();
+      cursor_row += pieces[cursor].lines;
+      cursor++;
+    }
+    // an edit reaching the end of its piece may join its last line to the
+    // next piece's first
+    while (cursor + 1 < pieces.size() && offset + removed >= cursor_offset + pieces[cursor].text.size()){
+      merge(cursor);
+    }
+
+    Piece& piece = pieces[cursor];
+    size_t at = offset - cursor_offset;
+    size += inserted.size() - removed;
+    try {
+      if (piece.lexed){
+	relex(piece.tokens, piece.text, Loc{1, cursor_row, file_path}, at, removed, inserted);
+      } else {
+	piece.text.replace(at, removed, inserted);
+	lex_piece(piece, cursor_row);
+      }
+    } catch (Compile_error&){
+      if (piece.lexed) piece.text.replace(at, removed, inserted);
+      piece.lexed = false;
+      reshape();
+      throw;
+    }
+    reshape();
+  }
+
+  // Updates the piece at the cursor after an edit, cuts it once it has
+  // grown to twice EDIT_PIECE_SIZE and drops it when it is empty.
+  void reshape(){
+    Piece& piece = pieces[cursor];
+    piece.update();
+    if (piece.text.size() > 2 * EDIT_PIECE_SIZE){
+      std::vector<Piece> parts = cut(piece.text, std::move(piece.tokens), 0, 0, piece.lexed);
+      pieces[cursor] = std::move(parts[0]);
+      pieces.insert(pieces.begin() + cursor + 1, std::make_move_iterator(parts.begin() + 1), std::make_move_iterator(parts.end()));
+    } else if (piece.text.empty() && pieces.size() > 1){
+      pieces.erase(pieces.begin() + cursor);
+      if (cursor == pieces.size()){
+	cursor--;
+	cursor_offset -= pieces[cursor].text.size();
+	cursor_row -= pieces[cursor].lines;
+      }
+    }
+  }
+
+  std::string text() const {
+    std::string res;
+    res.reserve(size);
+    for (auto& piece : pieces) res += piece.text;
+    return res;
+  }
+
+  // Lexes the pieces whose last edit did not lex again, which throws the
+  // first lex error of the file, if it still has one.
+  void lex_stale(){
+    int row = 1;
+    for (auto& piece : pieces){
+      if (!piece.lexed) lex_piece(piece, row);
+      row += piece.lines;
+    }
+  }
+
+  // The tokens of pieces [first, last), which must be lexed, with offsets
+  // and rows counted from the start of the file: the first piece starts at
+  // `offset` and `row`.
+  Tokens tokens(size_t first, size_t last, size_t offset, int row) const {
+    Tokens res;
+    for (size_t i = first; i < last; ++i){
+      for (auto token : pieces[i].tokens){
+	token.offset += offset;
+	token.loc.row += row;
+	res.push_back(std::move(token));
+      }
+      offset += pieces[i].text.size();
+      row += pieces[i].lines;
+    }
+    return res;
+  }
+};
+
+enum class Keyword {
+  Func,
+  Return,
+  Import,
+  Export,
+  Comptime
+};
+
+#define KEYWORD_COUNT (int(Keyword::Comptime) + 1)
+
+static constexpr std::array<std::string_view, KEYWORD_COUNT> keyword_names = {
+  "func", "return", "import", "export", "comptime",
+};
+
+
+struct Value {
+  enum class Type {
+    Int,
+    Float,
+    Ptr,
+    Char,
+    Str,
+    Bool,
+    Void,
+    Count
+  } type;
+
+  static inline std::unordered_map<std::string, Type> type_as_name = {
+    {"int", Type::Int},
+    {"float", Type::Float},
+    {"ptr", Type::Ptr},
+    {"char", Type::Char},
+    {"str", Type::Str},
+    {"bool", Type::Bool},    
+  };
+
+  static inline std::unordered_map<Atom, Type> type_as_atom = [](){
+    std::unordered_map<Atom, Type> res;
+    for (auto& [name, type] : type_as_name) res[atoms.intern(name)] = type;
+    return res;
+  }();
+
+  static bool is_valid_type(const std::string& n){
+    return Value::type_as_name.contains(n);
+  }
+
+  static bool is_valid_type(Atom a){
+    return Value::type_as_atom.contains(a);
+  }
+
+};
+
+typedef int Type_id;
+
+struct Type_info {
+  enum class Kind {
+    Primitive,
+    Ptr,
+    Func
+  } kind;
+  Value::Type primitive{Value::Type::Count};
+  Type_id elem{-1};    // Ptr: the pointee
+  Type_id ret{-1};     // Func: the return type
+  int first_param{0};  // Func: range in Type_table::params
+  int param_count{0};
+};
+
+// Hash-consed types: structurally equal types share one Type_id, so type
+// equality is an integer compare. Primitive types are interned first and
+// their ids equal their Value::Type.
+struct Type_table {
+  struct Key_hash {
+    size_t operator()(const std::vector<int>& key) const {
+      size_t h = 14695981039346656037ull;
+      for (int k : key){
+	h = (h ^ uint32_t(k)) * 1099511628211ull;
+      }
+      return h;
+    }
+  };
+
+  std::vector<Type_info> types;
+  std::vector<Type_id> params;
+  std::unordered_map<std::vector<int>, Type_id, Key_hash> interned;
+  std::vector<int> key; // scratch, reused between lookups
+
+  Type_table(){
+    for (int i = 0; i < int(Value::Type::Count); ++i){
+      Type_info info{Type_info::Kind::Primitive};
+      info.primitive = Value::Type(i);
+      key = {int(Type_info::Kind::Primitive), i};
+      intern(info, nullptr, 0);
+    }
+  }
+
+  Type_id primitive(Value::Type t) const { return Type_id(t); }
+
+  Type_id pointer(Type_id elem){
+    Type_info info{Type_info::Kind::Ptr};
+    info.elem = elem;
+    key = {int(Type_info::Kind::Ptr), elem};
+    return intern(info, nullptr, 0);
+  }
+
+  Type_id function(const Type_id* param_types, size_t count, Type_id ret){
+    Type_info info{Type_info::Kind::Func};
+    info.ret = ret;
+    key = {int(Type_info::Kind::Func), ret};
+    key.insert(key.end(), param_types, param_types + count);
+    return intern(info, param_types, count);
+  }
+
+  Type_id function(const std::vector<Value>& args, Value ret){
+    std::vector<Type_id> param_types;
+    for (auto& a : args) param_types.push_back(primitive(a.type));
+    return function(param_types.data(), param_types.size(), primitive(ret.type));
+  }
+
+  const Type_info& operator[](Type_id id) const { return types[id]; }
+
+  // Whether the function type `func` takes exactly `param_types`. Unlike
+  // function() this never interns, so it is safe while the table is shared.
+  bool accepts(Type_id func, const Type_id* param_types, size_t count) const {
+    const Type_info& t = types[func];
+    return size_t(t.param_count) == count && std::equal(param_types, param_types + count, params.begin() + t.first_param);
+  }
+
+  std::string name(Type_id id) const {
+    const Type_info& t = types[id];
+    switch (t.kind){
+    case Type_info::Kind::Primitive: {
+      if (t.primitive == Value::Type::Void) return "void";
+      for (auto& [n, type] : Value::type_as_name){
+	if (type == t.primitive) return n;
+      }
+      UNREACHABLE();
+    } break;
+    case Type_info::Kind::Ptr: {
+      return FMT("ptr({})", name(t.elem));
+    } break;
+    case Type_info::Kind::Func: {
+      std::string res = "func(";
+      for (int i = 0; i < t.param_count; ++i){
+	if (i > 0) res += ", ";
+	res += name(params[t.first_param + i]);
+      }
+      return FMT("{}) -> {}", res, name(t.ret));
+    } break;
+    default: {
+      UNREACHABLE();
+    } break;
+    }
+    return {};
+  }
+
+private:
+  // `key` must already hold the structural key of `info`.
+  Type_id intern(Type_info info, const Type_id* param_types, size_t count){
+    MEM_SITE("Type_table");
+    auto it = interned.find(key);
+    if (it != interned.end()) return it->second;
+    info.first_param = int(params.size());
+    info.param_count = int(count);
+    params.insert(params.end(), param_types, param_types + count);
+    Type_id id = Type_id(types.size());
+    types.push_back(info);
+    interned.emplace(key, id);
+    return id;
+  }
+};
+
+Type_table type_table;
+
+// Whether values of the type can be known at compile time (see Constant).
+bool is_scalar(Value::Type type){
+  return type == Value::Type::Int || type == Value::Type::Float || type == Value::Type::Char || type == Value::Type::Bool;
+}
+
+bool is_scalar(Type_id type){
+  const Type_info& info = type_table[type];
+  return info.kind == Type_info::Kind::Primitive && is_scalar(info.primitive);
+}
+
+struct Block {
+  std::vector<Token> _tokens;
+  std::shared_ptr<const std::string> source;
+  size_t begin{0}, end{0}; // the body in `source`, without the braces
+  Loc start;               // where `begin` is
+  bool lexed{true};
+
+  // Records the body that follows `curl_token`. When the lexer skipped it,
+  // only its byte range is kept and tokens() lexes it on first use.
+  void collect_values(Token& curl_token, Tokens& tokens){
+    auto it = sources.find(curl_token.loc.file_path);
+    if (it != sources.end()) source = it->second;
+    begin = curl_token.offset + 1;
+    start = curl_token.loc;
+    start.col += 1;
+
+    Option<Token> T;
+    int depth = 0;
+    do {
+      T = pop_token(tokens);
+      if (!T) {
+	compiler_error(curl_token, "Unclosed Function body");
+      }
+      Token& token = T.unwrap();
+      if (token.type == Token::Type::Close_curl && depth == 0){
+	end = token.offset;
+	break;
+      }
+      if (token.type == Token::Type::Open_curl) depth++;
+      if (token.type == Token::Type::Close_curl) depth--;
+      _tokens.push_back(std::move(token));
+    } while (T);
+    lexed = !_tokens.empty() || !source;
+  }
+
+  Tokens& tokens(){
+    if (!lexed){
+      MEM_SITE("Block::tokens");
+      lexed = true;
+      lex_lines(std::string_view(*source).substr(begin, end - begin), start, begin, _tokens);
+    }
+    return _tokens;
+  }
+};
+
+
+// Function bodies are parsed into statements over flat expression nodes.
+// Nodes are appended children first, so walking `exprs` in creation order
+// visits every operand before the node that uses it, and no pass over an
+// expression needs to recurse.
+struct Expr {
+  enum class Kind : uint8_t {
+    Number,
+    String,
+    Char,
+    Name,
+    Call,
+    Negate,
+    Binary,
+    Comptime
+  } kind;
+  Token::Type op{Token::Type::Plus}; // Binary
+  int a{-1}, b{-1};  // Binary: lhs and rhs; Negate, Comptime: a; Call: Ast::args[a .. a+b);
+                     // Name: a is the frame slot of the argument or local, set by the checker
+  int token{-1};     // into the body tokens: the literal, name, callee or operator
+  Type_id type{-1};  // set by check_functions()
+};
+
+struct Stmt {
+  enum class Kind : uint8_t {
+    Expr,
+    Local,
+    Return,
+    Open_scope,
+    Close_scope
+  } kind;
+  int token{-1};    // `return`, the local's name or the brace
+  int first{0};     // the statement's nodes are exprs[first .. expr]
+  int expr{-1};     // root node, -1 for none
+  Value::Type local_type{Value::Type::Void};
+};
+
+// A value known at compile time: `int`, `char` and `bool` values are held
+// in `bits` as integers, a `float` as its bit pattern. Void when unknown.
+struct Constant {
+  Value::Type type{Value::Type::Void};
+  int64_t bits{0};
+
+  double as_float() const { return std::bit_cast<double>(bits); }
+  static Constant of_float(double f){ return {Value::Type::Float, std::bit_cast<int64_t>(f)}; }
+  static Constant of_number(const Token& t){
+    return {t.type == Token::Type::Float ? Value::Type::Float : Value::Type::Int, t.number};
+  }
+};
+
+struct Ast {
+  std::vector<Expr> exprs;
+  std::vector<int> args; // call arguments, by node
+  std::vector<Stmt> stmts;
+  std::vector<Constant> consts; // by node, set by fold_comptime()
+  int locals{0};                // frame slots after the arguments, one per Local
+  bool parsed{false};
+};
+
+struct Function {
+  std::string name;
+  Atom name_atom{0};
+  std::vector<Value> args;
+  std::vector<Token> arg_tokens;
+  Block block;
+  Ast ast;
+  Value return_value{Value::Type::Void};
+  Type_id type{-1};
+  Token token;
+  bool exported{false};
+  bool imported{false}; // declared by a module interface, has no body
+  int builtin{-1};      // into `builtins` when the C runtime provides it, has no body
+};
+
+std::vector<Function> functions;
+
+struct Symbol {
+  enum class Kind {
+    Function,
+    Argument,
+    Local
+  } kind;
+  int index{-1}; // into `functions` for Function; for Argument and Local, the frame slot:
+                 // arguments by position, then locals in declaration order
+  Type_id type{-1};
+};
+
+// Nested scopes over one flat open-addressing table keyed by Atom.
+// Every declaration pushes a binding that remembers the binding it shadows,
+// so lookup is a single probe and pop_scope() just unwinds the binding stack.
+// The slots, bindings and frames keep their capacity between scopes.
+struct Symbol_table {
+  struct Slot {
+    Atom name{EMPTY_SLOT};
+    int binding{-1};
+  };
+  struct Binding {
+    Atom name;
+    Symbol symbol;
+    int shadowed;
+    int depth;
+  };
+
+  static constexpr Atom EMPTY_SLOT = ~Atom(0);
+
+  std::vector<Slot> slots;
+  std::vector<Binding> bindings;
+  std::vector<size_t> frames;
+  size_t used_slots{0};
+
+  int depth() const { return int(frames.size()); }
+
+  void push_scope(){
+    frames.push_back(bindings.size());
+  }
+
+  void pop_scope(){
+    ASSERT(!frames.empty());
+    size_t mark = frames.back();
+    frames.pop_back();
+    while (bindings.size() > mark){
+      Binding& b = bindings.back();
+      find_slot(b.name).binding = b.shadowed;
+      bindings.pop_back();
+    }
+  }
+
+  // Returns false if `name` is already declared in the innermost scope.
+  bool declare(Atom name, Symbol symbol){
+    MEM_SITE("Symbol_table");
+    if ((used_slots + 1) * 2 > slots.size()) grow();
+    Slot& slot = find_slot(name);
+    if (slot.name == EMPTY_SLOT){
+      slot.name = name;
+      used_slots++;
+    }
+    if (slot.binding != -1 && bindings[slot.binding].depth == depth()){
+      return false;
+    }
+    bindings.push_back({name, symbol, slot.binding, depth()});
+    slot.binding = int(bindings.size() - 1);
+    return true;
+  }
+
+  Symbol* lookup(Atom name){
+    if (slots.empty()) return nullptr;
+    Slot& slot = find_slot(name);
+    if (slot.binding == -1) return nullptr;
+    return &bindings[slot.binding].symbol;
+  }
+
+  // Points Function symbols at their new place in `functions` after it was
+  // compacted; `new_index[old]` is -1 for a dropped function.
+  void remap_functions(const std::vector<int>& new_index){
+    for (auto& b : bindings){
+      if (b.symbol.kind == Symbol::Kind::Function) b.symbol.index = new_index[b.symbol.index];
+    }
+  }
+
+  void clear(){
+    slots.assign(slots.size(), Slot{});
+    bindings.clear();
+    frames.clear();
+    used_slots = 0;
+  }
+
+private:
+  Slot& find_slot(Atom name){
+    size_t mask = slots.size() - 1;
+    size_t i = (name * 0x9E3779B9u) & mask;
+    while (slots[i].name != EMPTY_SLOT && slots[i].name != name){
+      i = (i + 1) & mask;
+    }
+    return slots[i];
+  }
+
+  void grow(){
+    std::vector<Slot> old = std::move(slots);
+    slots.assign(old.empty() ? 64 : old.size() * 2, Slot{});
+    for (auto& s : old){
+      if (s.name != EMPTY_SLOT) find_slot(s.name) = s;
+    }
+  }
+};
+
+Symbol_table symbols;
+
+static std::unordered_map<Atom, Keyword> keywords = [](){
+  std::unordered_map<Atom, Keyword> res;
+  for (int k = 0; k < KEYWORD_COUNT; ++k) res[atoms.intern(keyword_names[k])] = Keyword(k);
+  return res;
+}();
+
+bool is_keyword(Atom name){
+  return keywords.contains(name);
+}
+
+
+
+// Processes --------------------------------------------------
+// Child processes (module builds, the C compiler) are started directly with
+// their arguments as a list, never through a shell, so paths may hold any
+// character.
+#if defined(_WIN32)
+#include <process.h>
+#else
+#include <spawn.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+extern char** environ;
+#endif
+
+// `s` with `"` and `\` escaped by a backslash.
+std::string escape_quotes(const std::string& s){
+  std::string res;
+  for (char c : s){
+    if (c == '\\' || c == '"') res += '\\';
+    res += c;
+  }
+  return res;
+}
+
+// `args` as a shell would read them, for the log.
+std::string command_line(const std::vector<std::string>& args){
+  std::string res;
+  for (auto& a : args){
+    if (!res.empty()) res += ' ';
+    bool plain = !a.empty() && a.find_first_of(" \t\"'\\$`") == std::string::npos;
+    res += plain ? a : FMT("\"{}\"", escape_quotes(a));
+  }
+  return res;
+}
+
+#if !defined(_WIN32)
+// Starts args[0], looked up in PATH, without waiting for it. Returns its
+// pid, or -1 when it could not be started. With `output_fd`, its stdout and
+// stderr go to a pipe whose read end is stored there.
+pid_t spawn_process(const std::vector<std::string>& args, int* output_fd = nullptr){
+  std::vector<char*> argv;
+  for (auto& a : args) argv.push_back(const_cast<char*>(a.c_str()));
+  argv.push_back(nullptr);
+  posix_spawn_file_actions_t actions;
+  posix_spawn_file_actions_init(&actions);
+  int pipe_fds[2] = {-1, -1};
+  if (output_fd){
+    if (pipe(pipe_fds) < 0) return -1;
+    fcntl(pipe_fds[0], F_SETFD, FD_CLOEXEC);
+    fcntl(pipe_fds[1], F_SETFD, FD_CLOEXEC);
+    posix_spawn_file_actions_adddup2(&actions, pipe_fds[1], 1);
+    posix_spawn_file_actions_adddup2(&actions, pipe_fds[1], 2);
+  }
+  pid_t pid;
+  int err = posix_spawnp(&pid, argv[0], &actions, nullptr, argv.data(), environ);
+  posix_spawn_file_actions_destroy(&actions);
+  if (output_fd){
+    close(pipe_fds[1]);
+    if (err != 0) close(pipe_fds[0]);
+    *output_fd = err != 0 ? -1 : pipe_fds[0];
+  }
+  return err != 0 ? -1 : pid;
+}
+
+// The exit status of the child `pid`, waiting for it to end, or -1 when it
+// was killed.
+int wait_process(pid_t pid){
+  int status = 0;
+  while (waitpid(pid, &status, 0) < 0){
+    if (errno != EINTR) return -1;
+  }
+  return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+#endif
+
+// Runs args[0], looked up in PATH, and waits for it. Returns its exit status,
+// or -1 when it could not be started or was killed. With `output`, its
+// stdout and stderr are collected there instead of going to ours.
+int run_process(const std::vector<std::string>& args, std::string* output = nullptr){
+#if defined(_WIN32)
+  std::vector<char*> argv;
+  // the child parses its command line again, so every argument is quoted
+  std::vector<std::string> quoted;
+  for (auto& a : args) quoted.push_back(FMT("\"{}\"", escape_quotes(a)));
+  for (auto& a : quoted) argv.push_back(a.data());
+  argv.push_back(nullptr);
+  (void)output;
+  intptr_t status = _spawnvp(_P_WAIT, args[0].c_str(), argv.data());
+  return status < 0 ? -1 : int(status);
+#else
+  int fd = -1;
+  pid_t pid = spawn_process(args, output ? &fd : nullptr);
+  if (pid < 0) return -1;
+  if (output){
+    char buf[4096];
+    ssize_t n;
+    while ((n = read(fd, buf, sizeof(buf))) > 0 || (n < 0 && errno == EINTR)){
+      if (n > 0) output->append(buf, size_t(n));
+    }
+    close(fd);
+  }
+  return wait_process(pid);
+#endif
+}
+
+void set_env(const char* name, const std::string& value){
+#if defined(_WIN32)
+  _putenv_s(name, value.c_str());
+#else
+  setenv(name, value.c_str(), 1);
+#endif
+}
+
+// Modules --------------------------------------------------
+// `hash --module lib.hash` writes lib.hashi, a binary interface that holds
+// only the signatures of the `export`ed functions, and lib.c for linking.
+// `import lib;` loads lib.hashi instead of lexing and parsing lib.hash, and
+// rebuilds it first when it is missing, older than the source or than the
+// interface of a module it imports, or written by another version. The
+// version changes whenever the layout or the C names of lib.c do. An
+// interface lists every module its own C code needs, so importing lib also
+// checks and links those, though only lib's functions come into scope.
+//
+// Interface layout (little endian):
+//   "HSHI" u32 version  u32 import count
+//   per import:   u16 path length, source path relative to the interface
+//   u32 function count
+//   per function: u16 name length, name bytes, u8 argument count,
+//                 u8 argument types..., u8 return type
+
+#define INTERFACE_EXT "hashi"
+#define INTERFACE_MAGIC "HSHI"
+#define INTERFACE_VERSION 3
+
+struct Module {
+  std::string name;
+  std::string source_path;
+  std::string c_path;
+  bool declared{false}; // imported by the program itself, not only by a module
+};
+
+std::vector<Module> imported_modules;
+std::string self_exe = "hash"; // argv[0], to build stale interfaces
+
+// Source paths of the modules being built by this process and the ones that
+// started it, one per line, so an import cycle is an error rather than
+// builds starting each other forever.
+#define MODULE_CHAIN_ENV "HASH_MODULE_CHAIN"
+
+// Builds a stale module and returns the exit status of the build. When
+// unset, `hash --module` runs in place. The daemon sets it to build in the
+// background: it returns MODULE_BUILD_PENDING until the build is done, and
+// require_module() then throws Module_build_pending to put the check off.
+std::function<int(const std::string& source_path)> build_module;
+
+#define MODULE_BUILD_PENDING (-2)
+
+struct Module_build_pending {
+  std::string source_path;
+};
+
+std::string module_file(const std::string& source_path, const char* ext){
+  return fs::path(source_path).replace_extension(ext).string();
+}
+
+void write_interface(const std::string& path){
+  std::string out = INTERFACE_MAGIC;
+  auto u8 = [&](uint8_t v){ out += char(v); };
+  auto u16 = [&](uint16_t v){ u8(uint8_t(v)); u8(uint8_t(v >> 8)); };
+  auto u32 = [&](uint32_t v){ u16(uint16_t(v)); u16(uint16_t(v >> 16)); };
+
+  u32(INTERFACE_VERSION);
+  fs::path dir = fs::path(path).parent_path();
+  u32(uint32_t(imported_modules.size()));
+  for (auto& module : imported_modules){
+    std::string rel = fs::path(module.source_path).lexically_relative(dir).generic_string();
+    if (rel.empty()) rel = module.source_path;
+    if (rel.size() > UINT16_MAX) fatal_error(FMT("ERROR: Module path `{}` is longer than {} bytes\n", module.source_path, UINT16_MAX));
+    u16(uint16_t(rel.size()));
+    out += rel;
+  }
+  uint32_t count = 0;
+  for (auto& func : functions) count += func.exported;
+  u32(count);
+  for (auto& func : functions){
+    if (!func.exported) continue;
+    if (func.name.size() > UINT16_MAX){
+      compiler_error(func.token, "Exported function name is longer than {} bytes", UINT16_MAX);
+    }
+    if (func.args.size() > UINT8_MAX){
+      compiler_error(func.token, "Exported function `{}` has {} arguments; a module interface holds at most {}", func.name, func.args.size(), UINT8_MAX);
+    }
+    u16(uint16_t(func.name.size()));
+    out += func.name;
+    u8(uint8_t(func.args.size()));
+    for (auto& arg : func.args) u8(uint8_t(arg.type));
+    u8(uint8_t(func.return_value.type));
+  }
+
+  std::ofstream ofs(path, std::ios::binary);
+  ofs << out;
+}
+
+// Declares the functions of the interface at `path` in the global scope.
+void load_interface(const std::string& path, const Token& import_token){
+  std::string in = file::slurp_file(path);
+  size_t at = 0;
+  bool ok = true;
+  auto u8 = [&]() -> uint8_t {
+    if (at >= in.size()){ ok = false; return 0; }
+    return uint8_t(in[at++]);
+  };
+  auto u16 = [&]() -> uint16_t { uint16_t lo = u8(); return uint16_t(lo | (u8() << 8)); };
+  auto u32 = [&]() -> uint32_t { uint32_t lo = u16(); return lo | (uint32_t(u16()) << 16); };
+  auto type = [&]() -> Value::Type {
+    uint8_t t = u8();
+    if (t >= uint8_t(Value::Type::Count)) ok = false;
+    return ok ? Value::Type(t) : Value::Type::Void;
+  };
+
+  if (!in.starts_with(INTERFACE_MAGIC)){
+    compiler_error(import_token, "`{}` is not a hash module interface", path);
+  }
+  at = 4;
+  if (u32() != INTERFACE_VERSION){
+    compiler_error(import_token, "`{}` was written by another version of hash", path);
+  }
+  // the imports were handled by require_module()
+  uint32_t imports = u32();
+  for (uint32_t i = 0; i < imports && ok; ++i){
+    at += u16();
+  }
+  uint32_t count = u32();
+  for (uint32_t i = 0; i < count && ok; ++i){
+    Function func;
+    uint16_t len = u16();
+    if (at + len > in.size()){ ok = false; break; }
+    func.name = in.substr(at, len);
+    at += len;
+    uint8_t argc = u8();
+    for (uint8_t a = 0; a < argc; ++a){
+      func.args.push_back(Value{type()});
+      Token arg_token = import_token;
+      arg_token.value = FMT("arg{}", a);
+      arg_token.atom = atoms.intern(arg_token.value);
+      func.arg_tokens.push_back(arg_token);
+    }
+    func.return_value = Value{type()};
+    if (!ok) break;
+    func.name_atom = atoms.intern(func.name);
+    func.type = type_table.function(func.args, func.return_value);
+    func.token = import_token;
+    func.token.value = func.name;
+    func.imported = true;
+
+    Symbol sym{Symbol::Kind::Function, int(functions.size()), func.type};
+    if (!symbols.declare(func.name_atom, sym)){
+      compiler_error(import_token, "Function `{}` imported from `{}` is already defined", func.name, import_token.value);
+    }
+    functions.push_back(std::move(func));
+  }
+  if (!ok){
+    compiler_error(import_token, "Module interface `{}` is corrupt", path);
+  }
+}
+
+// Whether the interface at `path` was written with this INTERFACE_VERSION.
+bool interface_is_current(const std::string& path){
+  std::ifstream in(path, std::ios::binary);
+  char header[8]{};
+  if (!in.read(header, sizeof(header))) return false;
+  uint32_t version = uint32_t(uint8_t(header[4])) | uint32_t(uint8_t(header[5])) << 8 |
+    uint32_t(uint8_t(header[6])) << 16 | uint32_t(uint8_t(header[7])) << 24;
+  return std::string_view(header, 4) == INTERFACE_MAGIC && version == INTERFACE_VERSION;
+}
+
+// The source paths of the modules the current interface at `path` lists,
+// or none when it cannot be read.
+std::vector<std::string> interface_imports(const std::string& path){
+  std::string in = file::slurp_file(path);
+  std::vector<std::string> res;
+  auto u16 = [&](size_t at){ return size_t(uint8_t(in[at])) | size_t(uint8_t(in[at + 1])) << 8; };
+  if (in.size() < 12) return res;
+  size_t count = u16(8) | u16(10) << 16;
+  fs::path dir = fs::path(path).parent_path();
+  size_t at = 12;
+  for (size_t i = 0; i < count && at + 2 <= in.size(); ++i){
+    size_t len = u16(at);
+    at += 2;
+    if (at + len > in.size()) break;
+    res.push_back((dir / in.substr(at, len)).lexically_normal().string());
+    at += len;
+  }
+  return res;
+}
+
+// Makes sure the interface of the module at `source_path`, and of every
+// module it imports, is current, rebuilding what is stale, and adds them
+// all to imported_modules so that their C code gets linked. Returns the
+// path of the interface. Failures are reported at `name`.
+std::string require_module(const std::string& source_path, const Token& name){
+  std::string interface_path = module_file(source_path, INTERFACE_EXT);
+  for (auto& m : imported_modules){
+    if (m.source_path == source_path) return interface_path;
+  }
+  // added before its imports are visited, so an import cycle ends here
+  Module module;
+  module.name = fs::path(source_path).stem().string();
+  module.source_path = source_path;
+  module.c_path = module_file(source_path, "c");
+  imported_modules.push_back(module);
+
+  std::error_code ec;
+  bool have_source = fs::exists(source_path, ec);
+  bool have_interface = fs::exists(interface_path, ec);
+  bool current = have_interface && interface_is_current(interface_path);
+  bool stale = !have_interface ||
+    (have_source && fs::last_write_time(interface_path, ec) < fs::last_write_time(source_path, ec)) ||
+    (have_source && !current);
+  if (current){
+    auto built = fs::last_write_time(interface_path, ec);
+    for (auto& dep : interface_imports(interface_path)){
+      std::string dep_interface = require_module(dep, name);
+      if (fs::last_write_time(dep_interface, ec) > built) stale = true;
+    }
+  }
+  if (stale){
+    if (!have_source){
+      compiler_error(name, "Cannot find module `{}` at `{}`", module.name, source_path);
+    }
+    const char* env = std::getenv(MODULE_CHAIN_ENV);
+    std::string chain = env ? env : "";
+    if (("\n" + chain).find("\n" + source_path + "\n") != std::string::npos){
+      compiler_error(name, "Module `{}` imports itself", module.name);
+    }
+    set_env(MODULE_CHAIN_ENV, chain + source_path + "\n");
+    int status = build_module ? build_module(source_path) : run_process({self_exe, "--module", source_path});
+    set_env(MODULE_CHAIN_ENV, chain);
+    if (status == MODULE_BUILD_PENDING){
+      throw Module_build_pending{source_path};
+    }
+    if (status != 0){
+      compiler_error(name, "Failed to build module `{}`", module.name);
+    }
+    // the new interface may import modules the old one did not
+    for (auto& dep : interface_imports(interface_path)) require_module(dep, name);
+  }
+  return interface_path;
+}
+
+void import_module(const Token& name){
+  fs::path dir = fs::path(name.loc.file_path).parent_path();
+  std::string source_path = (dir / (name.value + "." FILE_EXT)).lexically_normal().string();
+  for (auto& m : imported_modules){
+    if (m.source_path == source_path && m.declared) return;
+  }
+  std::string interface_path = require_module(source_path, name);
+  load_interface(interface_path, name);
+  for (auto& m : imported_modules){
+    if (m.source_path == source_path) m.declared = true;
+  }
+}
+
+// Grammar --------------------------------------------------
+// The top level of a program is described by the LL(1) grammar below.
+// Right-hand sides mix terminals, rules and actions; an action runs when the
+// parser reaches it, with the token matched last. The prediction table is
+// built from the grammar while the compiler is built, so parsing is a loop
+// over a symbol stack with one table lookup per rule. Function bodies are
+// only collected here; parse_body() splits them into statements later.
+
+// Terminals: every token type, the keywords (which the lexer produces as
+// Names) and the end of the input. A set of terminals fits in a uint64_t.
+#define TERMINAL_COUNT (TOKEN_TYPE_COUNT + KEYWORD_COUNT + 1)
+#define END_OF_INPUT (TERMINAL_COUNT - 1)
+static_assert(TERMINAL_COUNT <= 64);
+
+enum class Rule : uint8_t {
+  Program,
+  Item,
+  Declaration,
+  Func_keyword,
+  Arguments,
+  More_arguments,
+  Argument,
+  Return_type,
+};
+
+#define RULE_COUNT (int(Rule::Return_type) + 1)
+
+enum class Action : uint8_t {
+  Name_module,
+  Import_module,
+  Mark_export,
+  Name_function,
+  Open_arguments,
+  Name_argument,
+  Type_argument,
+  Close_arguments,
+  Type_return,
+  Collect_body,
+  Outside_function,
+};
+
+#define ACTION_COUNT (int(Action::Outside_function) + 1)
+
+struct Grammar_symbol {
+  enum class Kind : uint8_t { Terminal, Rule, Action } kind{Kind::Terminal};
+  uint8_t id{0};
+
+  constexpr Grammar_symbol() = default;
+  constexpr Grammar_symbol(Token::Type t): kind(Kind::Terminal), id(uint8_t(t)) {}
+  constexpr Grammar_symbol(Keyword k): kind(Kind::Terminal), id(uint8_t(TOKEN_TYPE_COUNT + int(k))) {}
+  constexpr Grammar_symbol(Rule r): kind(Kind::Rule), id(uint8_t(r)) {}
+  constexpr Grammar_symbol(Action a): kind(Kind::Action), id(uint8_t(a)) {}
+};
+
+#define MAX_PRODUCTION_SIZE 12
+
+struct Production {
+  Rule lhs;
+  std::array<Grammar_symbol, MAX_PRODUCTION_SIZE> rhs{};
+  int size{0};
+
+  constexpr Production(Rule lhs, std::initializer_list<Grammar_symbol> symbols): lhs(lhs){
+    for (const Grammar_symbol& s : symbols) rhs[size++] = s;
+  }
+};
+
+static constexpr auto grammar = [](){
+  using enum Token::Type;
+  using enum Rule;
+  using enum Action;
+  return std::to_array<Production>({
+    {Program,        {Item, Program}},
+    {Program,        {}},
+    {Item,           {Keyword::Import, Name, Name_module, Semi_colon, Import_module}},
+    {Item,           {Keyword::Export, Mark_export, Declaration}},
+    {Item,           {Declaration}},
+    {Item,           {Keyword::Return, Outside_function}},
+    {Item,           {Keyword::Comptime, Outside_function}},
+    {Declaration,    {Func_keyword, Name, Name_function,
+		      Open_paren, Open_arguments, Arguments, Close_paren, Close_arguments,
+		      Return_type, Open_curl, Collect_body}},
+    {Func_keyword,   {Keyword::Func}},
+    {Func_keyword,   {}},
+    {Arguments,      {Argument, More_arguments}},
+    {Arguments,      {}},
+    {More_arguments, {Comma, Argument, More_arguments}},
+    {More_arguments, {}},
+    {Argument,       {Name, Name_argument, Colon, Name, Type_argument}},
+    {Return_type,    {Returner, Name, Type_return}},
+    {Return_type,    {}},
+  });
+}();
+
+// Not constexpr: reaching it while the table is built fails the build.
+inline void grammar_conflict(){ UNREACHABLE(); }
+
+struct Ll1_table {
+  std::array<std::array<int8_t, TERMINAL_COUNT>, RULE_COUNT> predict{}; // production, -1 for none
+  std::array<uint64_t, RULE_COUNT> expects{}; // terminals with a prediction
+};
+
+// FIRST and FOLLOW sets by fixed-point iteration, then one prediction per
+// rule and lookahead terminal. Two productions predicted by the same
+// terminal make the grammar ambiguous for LL(1).
+constexpr Ll1_table build_ll1_table(){
+  std::array<bool, RULE_COUNT> nullable{};
+  std::array<uint64_t, RULE_COUNT> first{}, follow{};
+
+  // FIRST of rhs[from ..] of `p`; sets `empty` if all of it can be empty.
+  auto first_of = [&](const Production& p, int from, bool& empty){
+    uint64_t res = 0;
+    for (int i = from; i < p.size; ++i){
+      const Grammar_symbol& s = p.rhs[i];
+      if (s.kind == Grammar_symbol::Kind::Terminal){
+	empty = false;
+	return res | (uint64_t(1) << s.id);
+      }
+      if (s.kind == Grammar_symbol::Kind::Rule){
+	res |= first[s.id];
+	if (!nullable[s.id]){
+	  empty = false;
+	  return res;
+	}
+      }
+    }
+    empty = true;
+    return res;
+  };
+
+  follow[int(Rule::Program)] = uint64_t(1) << END_OF_INPUT;
+  for (bool changed = true; changed;){
+    changed = false;
+    for (const Production& p : grammar){
+      int lhs = int(p.lhs);
+      bool empty = false;
+      uint64_t f = first_of(p, 0, empty);
+      if ((first[lhs] | f) != first[lhs] || (empty && !nullable[lhs])){
+	first[lhs] |= f;
+	nullable[lhs] = nullable[lhs] || empty;
+	changed = true;
+      }
+      for (int i = 0; i < p.size; ++i){
+	if (p.rhs[i].kind != Grammar_symbol::Kind::Rule) continue;
+	int r = p.rhs[i].id;
+	uint64_t f = first_of(p, i + 1, empty);
+	if (empty) f |= follow[lhs];
+	if ((follow[r] | f) != follow[r]){
+	  follow[r] |= f;
+	  changed = true;
+	}
+      }
+    }
+  }
+
+  Ll1_table res;
+  for (auto& row : res.predict) row.fill(-1);
+  for (int n = 0; n < int(grammar.size()); ++n){
+    const Production& p = grammar[n];
+    int lhs = int(p.lhs);
+    bool empty = false;
+    uint64_t lookahead = first_of(p, 0, empty);
+    if (empty) lookahead |= follow[lhs];
+    for (int t = 0; t < TERMINAL_COUNT; ++t){
+      if (!(lookahead & (uint64_t(1) << t))) continue;
+      if (res.predict[lhs][t] != -1) grammar_conflict();
+      res.predict[lhs][t] = int8_t(n);
+    }
+    res.expects[lhs] |= lookahead;
+  }
+  return res;
+}
+
+static constexpr Ll1_table ll1_table = build_ll1_table();
+
+static constexpr auto terminal_names = [](){
+  std::array<std::string_view, TERMINAL_COUNT> names{};
+  using enum Token::Type;
+  names[int(Name)]        = "a name";
+  names[int(Number)]      = "a number";
+  names[int(Float)]       = "a number";
+  names[int(Open_paren)]  = "`(`";
+  names[int(Close_paren)] = "`)`";
+  names[int(Semi_colon)]  = "`;`";
+  names[int(Colon)]       = "`:`";
+  names[int(Comma)]       = "`,`";
+  names[int(Minus)]       = "`-`";
+  names[int(Plus)]        = "`+`";
+  names[int(Mult)]        = "`*`";
+  names[int(Div)]         = "`/`";
+  names[int(Mod)]         = "`%`";
+  names[int(Equal)]       = "`=`";
+  names[int(Returner)]    = "`->`";
+  names[int(Open_curl)]   = "`{`";
+  names[int(Close_curl)]  = "`}`";
+  names[int(D_quote)]     = "`\"`";
+  names[int(Quote)]       = "`'`";
+  names[int(String)]      = "a string";
+  names[int(Char)]        = "a char";
+  names[TOKEN_TYPE_COUNT + int(Keyword::Func)]     = "`func`";
+  names[TOKEN_TYPE_COUNT + int(Keyword::Return)]   = "`return`";
+  names[TOKEN_TYPE_COUNT + int(Keyword::Import)]   = "`import`";
+  names[TOKEN_TYPE_COUNT + int(Keyword::Export)]   = "`export`";
+  names[TOKEN_TYPE_COUNT + int(Keyword::Comptime)] = "`comptime`";
+  names[END_OF_INPUT] = "the end of the file";
+  return names;
+}();
+
+// State of parse_tokens() that the actions share.
+struct Top_parser {
+  Tokens& tokens; // reversed: the next token is at the back
+  Token last{};   // the token matched last
+  Token module{};
+  Token argument{};
+  Function func{};
+  bool exporting{false};
+  std::vector<std::pair<size_t, Token>>* imports{nullptr};
+
+  int lookahead() const {
+    if (tokens.empty()) return END_OF_INPUT;
+    const Token& t = tokens.back();
+    if (t.type == Token::Type::Name){
+      auto it = keywords.find(t.atom);
+      if (it != keywords.end()) return TOKEN_TYPE_COUNT + int(it->second);
+    }
+    return int(t.type);
+  }
+
+  Value::Type type_of(const Token& t) const {
+    if (!Value::is_valid_type(t.atom)) {
+      compiler_error(t, "Unkown type `{}`", t.value);
+    }
+    return Value::type_as_atom[t.atom];
+  }
+
+  // Reports that the next token is none of `expected`.
+  void unexpected(uint64_t expected) const {
+    std::string what;
+    int n = std::popcount(expected);
+    for (int i = 0; expected; ++i, expected &= expected - 1){
+      if (i > 0) what += i + 1 == n ? " or " : ", ";
+      what += terminal_names[std::countr_zero(expected)];
+    }
+    if (tokens.empty()){
+      compiler_error(last, "Expected {} after `{}`", what, last.value);
+    }
+    const Token& t = tokens.back();
+    if (n > 3){
+      compiler_error(t, "`{}` is unexpected here", t.value);
+    }
+    compiler_error(t, "Expected {}, found `{}`", what, t.value);
+  }
+};
+
+static constexpr auto parse_actions = [](){
+  std::array<void(*)(Top_parser&), ACTION_COUNT> actions{};
+  using enum Action;
+  actions[int(Name_module)] = [](Top_parser& p){ p.module = p.last; };
+  actions[int(Import_module)] = [](Top_parser& p){
+    if (p.imports) p.imports->push_back({functions.size(), p.module});
+    else import_module(p.module);
+  };
+  actions[int(Mark_export)] = [](Top_parser& p){ p.exporting = true; };
+  actions[int(Name_function)] = [](Top_parser& p){
+    p.func = Function{};
+    p.func.exported = p.exporting;
+    p.exporting = false;
+    p.func.name = p.last.value;
+    p.func.name_atom = p.last.atom;
+    p.func.token = p.last;
+  };
+  // Arguments are declared in a scope of their own to find duplicates.
+  actions[int(Open_arguments)] = [](Top_parser&){ symbols.push_scope(); };
+  actions[int(Name_argument)] = [](Top_parser& p){ p.argument = p.last; };
+  actions[int(Type_argument)] = [](Top_parser& p){
+    Function& func = p.func;
+    Value arg{p.type_of(p.last)};
+    Symbol sym{Symbol::Kind::Argument, int(func.args.size()), type_table.primitive(arg.type)};
+    if (!symbols.declare(p.argument.atom, sym)){
+      compiler_error(p.argument, "Argument `{}` is already declared", p.argument.value);
+    }
+    func.args.push_back(arg);
+    func.arg_tokens.push_back(std::move(p.argument));
+  };
+  actions[int(Close_arguments)] = [](Top_parser&){ symbols.pop_scope(); };
+  actions[int(Type_return)] = [](Top_parser& p){ p.func.return_value.type = p.type_of(p.last); };
+  actions[int(Collect_body)] = [](Top_parser& p){
+    Function& func = p.func;
+    func.block.collect_values(p.last, p.tokens);
+    func.type = type_table.function(func.args, func.return_value);
+    Symbol sym{Symbol::Kind::Function, int(functions.size()), func.type};
+    if (!symbols.declare(func.name_atom, sym)){
+      compiler_error(func.token, "Function `{}` is already defined", func.name);
+    }
+    functions.push_back(std::move(func));
+  };
+  actions[int(Outside_function)] = [](Top_parser& p){
+    compiler_error(p.last, "`{}` outside of a function", p.last.value);
+  };
+  return actions;
+}();
+
+// With `imports`, modules are not imported: each import is appended there
+// instead, after the number of functions declared before it.
+void parse_tokens(Tokens& tokens, std::vector<std::pair<size_t, Token>>* imports = nullptr){
+
+  mem::set_phase(mem::Phase::Parse);
+  MEM_SITE("parse_tokens");
+  std::reverse(tokens.begin(), tokens.end());
+  symbols.push_scope(); // global scope
+
+  Top_parser parser{tokens};
+  parser.imports = imports;
+  std::vector<Grammar_symbol> stack{Rule::Program};
+  while (!stack.empty()){
+    Grammar_symbol s = stack.back();
+    stack.pop_back();
+    switch (s.kind){
+    case Grammar_symbol::Kind::Terminal: {
+      if (parser.lookahead() != s.id){
+	parser.unexpected(uint64_t(1) << s.id);
+      }
+      parser.last = std::move(tokens.back());
+      tokens.pop_back();
+    } break;
+    case Grammar_symbol::Kind::Rule: {
+      int n = ll1_table.predict[s.id][parser.lookahead()];
+      if (n < 0){
+	parser.unexpected(ll1_table.expects[s.id]);
+      }
+      const Production& p = grammar[n];
+      for (int i = p.size - 1; i >= 0; --i) stack.push_back(p.rhs[i]);
+    } break;
+    case Grammar_symbol::Kind::Action: {
+      parse_actions[s.id](parser);
+    } break;
+    default: {
+      UNREACHABLE();
+    } break;
+    }
+  }
+}
+
+// Prelude --------------------------------------------------
+// Declared before every program, in an outer scope of its own, so the
+// program's functions shadow it and dead function elimination drops what is
+// not called. The source is tokenized while the compiler is built; loading
+// it only turns the static tokens into Tokens.
+#include "prelude.hpp"
+#define PRELUDE_PATH "<prelude>"
+
+static constexpr auto prelude_tokens = lex_static<count_static_tokens(prelude_source)>(prelude_source);
+
+void parse_prelude(){
+  MEM_SITE("parse_prelude");
+  Tokens tokens(prelude_tokens.count);
+  for (size_t i = 0; i < prelude_tokens.count; ++i){
+    const Static_token& st = prelude_tokens.tokens[i];
+    Token& token = tokens[i];
+    token.type = st.type;
+    token.value = prelude_source.substr(st.begin, st.end - st.begin);
+    token.loc = {st.col, st.row, PRELUDE_PATH};
+    token.offset = st.begin;
+    token.number = st.number;
+    if (token.type == Token::Type::Name) token.atom = atoms.intern(token.value);
+  }
+  parse_tokens(tokens);
+}
+
+// Expressions --------------------------------------------------
+// Shunting-yard over `binary_ops` with explicit operand and operator stacks:
+// nesting depth never reaches the native stack, and every token is pushed
+// and popped at most once, so parsing is linear in the expression size.
+
+struct Op_info {
+  int prec{0}; // 0: not a binary operator
+  bool right_assoc{false};
+};
+
+#define UNARY_PREC 30
+
+static const std::array<Op_info, TOKEN_TYPE_COUNT> binary_ops = [](){
+  std::array<Op_info, TOKEN_TYPE_COUNT> ops{};
+  ops[int(Token::Type::Equal)] = {1, true};
+  ops[int(Token::Type::Plus)]  = {10, false};
+  ops[int(Token::Type::Minus)] = {10, false};
+  ops[int(Token::Type::Mult)]  = {20, false};
+  ops[int(Token::Type::Div)]   = {20, false};
+  ops[int(Token::Type::Mod)]   = {20, false};
+  return ops;
+}();
+
+int expr_prec(const Expr& e){
+  if (e.kind == Expr::Kind::Binary) return binary_ops[int(e.op)].prec;
+  if (e.kind == Expr::Kind::Negate) return UNARY_PREC;
+  return INT_MAX;
+}
+
+struct Expr_parser {
+  struct Pending {
+    enum class Kind {
+      Binary,
+      Negate,
+      Comptime,
+      Paren,
+      Call
+    } kind;
+    int token;
+    size_t base{0}; // Paren/Call: operand count when it was opened
+  };
+
+  Tokens& body;
+  Ast& ast;
+  std::vector<int> operands{};
+  std::vector<Pending> ops{};
+
+  int push_node(Expr e){
+    MEM_SITE("Ast");
+    ast.exprs.push_back(e);
+    return int(ast.exprs.size() - 1);
+  }
+
+  void reduce(){
+    Pending p = ops.back();
+    ops.pop_back();
+    Expr e{p.kind == Pending::Kind::Negate ? Expr::Kind::Negate
+	   : p.kind == Pending::Kind::Comptime ? Expr::Kind::Comptime : Expr::Kind::Binary};
+    e.op = body[p.token].type;
+    e.token = p.token;
+    if (e.kind == Expr::Kind::Binary){
+      e.b = operands.back();
+      operands.pop_back();
+    }
+    e.a = operands.back();
+    operands.back() = push_node(e);
+  }
+
+  // Reduces operators down to the innermost open paren or call.
+  void reduce_group(){
+    while (!ops.empty() && ops.back().kind != Pending::Kind::Paren && ops.back().kind != Pending::Kind::Call){
+      reduce();
+    }
+  }
+
+  void finish_call(Pending call){
+    Expr e{Expr::Kind::Call};
+    e.token = call.token;
+    e.a = int(ast.args.size());
+    e.b = int(operands.size() - call.base);
+    ast.args.insert(ast.args.end(), operands.begin() + call.base, operands.end());
+    operands.resize(call.base);
+    operands.push_back(push_node(e));
+  }
+
+  // Parses the expression at body[i] up to the `;` that ends it (not
+  // consumed) and returns its root node.
+  int parse(size_t& i){
+    operands.clear();
+    ops.clear();
+    bool want_operand = true;
+    while (true){
+      if (i >= body.size()){
+	compiler_error(body.back(), "Expected `;` after `{}`", body.back().value);
+      }
+      Token& t = body[i];
+      if (want_operand){
+	switch (t.type){
+	case Token::Type::Number:
+	case Token::Type::Float: {
+	  operands.push_back(push_node({Expr::Kind::Number, t.type, -1, -1, int(i)}));
+	  want_operand = false;
+	  i += 1;
+	} break;
+	case Token::Type::D_quote: {
+	  operands.push_back(push_node({Expr::Kind::String, t.type, -1, -1, int(i + 1)}));
+	  want_operand = false;
+	  i += 3;
+	} break;
+	case Token::Type::Quote: {
+	  operands.push_back(push_node({Expr::Kind::Char, t.type, -1, -1, int(i + 1)}));
+	  want_operand = false;
+	  i += 3;
+	} break;
+	case Token::Type::Name: {
+	  if (is_keyword(t.atom) && keywords.at(t.atom) == Keyword::Comptime){
+	    ops.push_back({Pending::Kind::Comptime, int(i)});
+	    i += 1;
+	    break;
+	  }
+	  if (is_keyword(t.atom)){
+	    compiler_error(t, "`{}` is unexpected here", t.value);
+	  }
+	  if (i + 1 < body.size() && body[i+1].type == Token::Type::Open_paren){
+	    Pending call{Pending::Kind::Call, int(i), operands.size()};
+	    i += 2;
+	    if (i < body.size() && body[i].type == Token::Type::Close_paren){
+	      finish_call(call);
+	      want_operand = false;
+	      i += 1;
+	    } else {
+	      ops.push_back(call);
+	    }
+	  } else {
+	    operands.push_back(push_node({Expr::Kind::Name, t.type, -1, -1, int(i)}));
+	    want_operand = false;
+	    i += 1;
+	  }
+	} break;
+	case Token::Type::Open_paren: {
+	  ops.push_back({Pending::Kind::Paren, int(i), operands.size()});
+	  i += 1;
+	} break;
+	case Token::Type::Minus: {
+	  ops.push_back({Pending::Kind::Negate, int(i)});
+	  i += 1;
+	} break;
+	default: {
+	  compiler_error(t, "Expected an expression, found `{}`", t.value);
+	} break;
+	}
+	continue;
+      }
+
+      const Op_info& op = binary_ops[int(t.type)];
+      if (op.prec > 0){
+	while (!ops.empty()){
+	  const Pending& top = ops.back();
+	  int top_prec = top.kind == Pending::Kind::Negate || top.kind == Pending::Kind::Comptime ? UNARY_PREC
+	    : top.kind == Pending::Kind::Binary ? binary_ops[int(body[top.token].type)].prec : 0;
+	  if (top_prec > op.prec || (top_prec == op.prec && !op.right_assoc)) reduce();
+	  else break;
+	}
+	ops.push_back({Pending::Kind::Binary, int(i)});
+	want_operand = true;
+	i += 1;
+      } else if (t.type == Token::Type::Comma){
+	reduce_group();
+	if (ops.empty() || ops.back().kind != Pending::Kind::Call){
+	  compiler_error(t, "`,` is unexpected here");
+	}
+	want_operand = true;
+	i += 1;
+      } else if (t.type == Token::Type::Close_paren){
+	reduce_group();
+	if (ops.empty()){
+	  compiler_error(t, "Unmatched `)`");
+	}
+	Pending group = ops.back();
+	ops.pop_back();
+	if (group.kind == Pending::Kind::Call) finish_call(group);
+	i += 1;
+      } else if (t.type == Token::Type::Semi_colon){
+	break;
+      } else {
+	compiler_error(t, "`{}` is unexpected here", t.value);
+      }
+    }
+    reduce_group();
+    if (!ops.empty()){
+      compiler_error(body[ops.back().token], "Unclosed parenthesis");
+    }
+    ASSERT(operands.size() == 1);
+    return operands.back();
+  }
+};
+
+// Splits the function body into statements:
+//   `return;`  `return expr;`  `name: type;`  `name: type = expr;`  `expr;`
+// and `{ ... }` scopes.
+void parse_body(Function& func){
+  Ast& ast = func.ast;
+  if (ast.parsed) return;
+  ast.parsed = true;
+  Tokens& body = func.block.tokens();
+  Expr_parser parser{body, ast};
+
+  auto expect_semi = [&](size_t& i){
+    if (i >= body.size() || body[i].type != Token::Type::Semi_colon){
+      Token& at = i < body.size() ? body[i] : body.back();
+      compiler_error(at, "Expected `;`, found `{}`", at.value);
+    }
+    i++;
+  };
+
+  size_t i = 0;
+  while (i < body.size()){
+    Token& t = body[i];
+    Stmt stmt{Stmt::Kind::Expr, int(i), int(ast.exprs.size())};
+    if (t.type == Token::Type::Semi_colon){
+      i++;
+      continue;
+    } else if (t.type == Token::Type::Open_curl){
+      stmt.kind = Stmt::Kind::Open_scope;
+      i++;
+    } else if (t.type == Token::Type::Close_curl){
+      stmt.kind = Stmt::Kind::Close_scope;
+      i++;
+    } else if (t.type == Token::Type::Name && is_keyword(t.atom) && keywords.at(t.atom) != Keyword::Comptime){
+      if (keywords.at(t.atom) != Keyword::Return){
+	compiler_error(t, "`{}` is unexpected here", t.value);
+      }
+      stmt.kind = Stmt::Kind::Return;
+      i++;
+      if (i < body.size() && body[i].type != Token::Type::Semi_colon){
+	stmt.expr = parser.parse(i);
+      }
+      expect_semi(i);
+    } else if (t.type == Token::Type::Name && i + 1 < body.size() && body[i+1].type == Token::Type::Colon){
+      if (i + 2 >= body.size() || !Value::is_valid_type(body[i+2].atom)){
+	compiler_error(t, "Local `{}` has no type", t.value);
+      }
+      stmt.kind = Stmt::Kind::Local;
+      stmt.local_type = Value::type_as_atom.at(body[i+2].atom);
+      i += 3;
+      if (i < body.size() && body[i].type == Token::Type::Equal){
+	i++;
+	stmt.expr = parser.parse(i);
+      }
+      expect_semi(i);
+    } else {
+      stmt.expr = parser.parse(i);
+      expect_semi(i);
+    }
+    MEM_SITE("Ast");
+    ast.stmts.push_back(stmt);
+  }
+}
+
+// Per-thread state of the checker. While bodies are checked the global
+// `symbols` and `type_table` are frozen: arguments and locals go into the
+// worker's own scope table, which shadows the global one, and the scratch
+// buffers keep their capacity from one function to the next.
+struct Checker {
+  Symbol_table locals;
+  std::vector<Type_id> arg_types;
+
+  Symbol* lookup(Atom name){
+    Symbol* sym = locals.lookup(name);
+    return sym ? sym : symbols.lookup(name);
+  }
+};
+
+// Types the nodes exprs[first .. last] in creation order; operands are
+// always typed before the node that uses them.
+void check_exprs(Checker& checker, Function& func, int first, int last){
+  Ast& ast = func.ast;
+  Tokens& body = func.block.tokens();
+  std::vector<Type_id>& arg_types = checker.arg_types;
+  for (int n = first; n <= last; ++n){
+    Expr& e = ast.exprs[n];
+    Token& t = body[e.token];
+    switch (e.kind){
+    case Expr::Kind::Number: {
+      e.type = type_table.primitive(t.type == Token::Type::Float ? Value::Type::Float : Value::Type::Int);
+    } break;
+    case Expr::Kind::String: {
+      e.type = type_table.primitive(Value::Type::Str);
+    } break;
+    case Expr::Kind::Char: {
+      e.type = type_table.primitive(Value::Type::Char);
+    } break;
+    case Expr::Kind::Name: {
+      Symbol* sym = checker.lookup(t.atom);
+      if (!sym){
+	compiler_error(t, "Undefined name `{}`", t.value);
+      }
+      if (sym->kind == Symbol::Kind::Function){
+	compiler_error(t, "Function `{}` is used as a value", t.value);
+      }
+      e.type = sym->type;
+      e.a = sym->index;
+    } break;
+    case Expr::Kind::Call: {
+      Symbol* sym = checker.lookup(t.atom);
+      if (!sym){
+	compiler_error(t, "Undefined name `{}`", t.value);
+      }
+      if (sym->kind != Symbol::Kind::Function){
+	compiler_error(t, "`{}` is not a function", t.value);
+      }
+      Function& callee = functions[sym->index];
+      arg_types.clear();
+      for (int a = e.a; a < e.a + e.b; ++a) arg_types.push_back(ast.exprs[ast.args[a]].type);
+      if (!type_table.accepts(callee.type, arg_types.data(), arg_types.size())){
+	std::string args;
+	for (size_t a = 0; a < arg_types.size(); ++a){
+	  if (a > 0) args += ", ";
+	  args += type_table.name(arg_types[a]);
+	}
+	compiler_error(t, "Cannot call `{}` of type `{}` with `({})`",
+		       callee.name, type_table.name(callee.type), args);
+      }
+      e.type = type_table[callee.type].ret;
+    } break;
+    case Expr::Kind::Negate: {
+      Type_id operand = ast.exprs[e.a].type;
+      if (operand != type_table.primitive(Value::Type::Int) && operand != type_table.primitive(Value::Type::Float)){
+	compiler_error(t, "Cannot negate `{}`", type_table.name(operand));
+      }
+      e.type = operand;
+    } break;
+    case Expr::Kind::Comptime: {
+      Type_id operand = ast.exprs[e.a].type;
+      if (!is_scalar(operand)){
+	compiler_error(t, "`comptime` needs an `int`, `float`, `char` or `bool` value, not `{}`", type_table.name(operand));
+      }
+      e.type = operand;
+    } break;
+    case Expr::Kind::Binary: {
+      Expr& lhs = ast.exprs[e.a];
+      Type_id l = lhs.type, r = ast.exprs[e.b].type;
+      if (e.op == Token::Type::Equal){
+	Symbol* target = lhs.kind == Expr::Kind::Name ? checker.lookup(body[lhs.token].atom) : nullptr;
+	if (!target){
+	  compiler_error(t, "Cannot assign to `{}`", body[lhs.token].value);
+	}
+	if (l != r){
+	  compiler_error(t, "Cannot assign `{}` to `{}` of type `{}`", type_table.name(r), body[lhs.token].value, type_table.name(l));
+	}
+      } else {
+	bool is_int = l == type_table.primitive(Value::Type::Int);
+	bool is_float = l == type_table.primitive(Value::Type::Float);
+	if (l != r || !(is_int || (is_float && e.op != Token::Type::Mod))){
+	  compiler_error(t, "Cannot apply `{}` to `{}` and `{}`", t.value, type_table.name(l), type_table.name(r));
+	}
+      }
+      e.type = l;
+    } break;
+    default: {
+      UNREACHABLE();
+    } break;
+    }
+  }
+}
+
+// Parses one function body, resolves its names against the global scope,
+// its arguments and the locals declared so far, and types its expressions.
+void check_function(Checker& checker, Function& func){
+  parse_body(func);
+  Tokens& body = func.block.tokens();
+  Type_id ret = type_table.primitive(func.return_value.type);
+  Symbol_table& scope = checker.locals;
+
+  scope.clear();
+  scope.push_scope();
+  func.ast.locals = 0;
+  for (size_t i = 0; i < func.args.size(); ++i){
+    Symbol sym{Symbol::Kind::Argument, int(i), type_table.primitive(func.args[i].type)};
+    scope.declare(func.arg_tokens[i].atom, sym);
+  }
+  for (Stmt& stmt : func.ast.stmts){
+    Token& t = body[stmt.token];
+    if (stmt.kind == Stmt::Kind::Open_scope){
+      scope.push_scope();
+      continue;
+    }
+    if (stmt.kind == Stmt::Kind::Close_scope){
+      if (scope.depth() > 1) scope.pop_scope();
+      continue;
+    }
+    if (stmt.expr != -1) check_exprs(checker, func, stmt.first, stmt.expr);
+    Type_id type = stmt.expr != -1 ? func.ast.exprs[stmt.expr].type : type_table.primitive(Value::Type::Void);
+
+    if (stmt.kind == Stmt::Kind::Return && type != ret){
+      compiler_error(t, "Cannot return `{}` from `{}`, which returns `{}`", type_table.name(type), func.name, type_table.name(ret));
+    }
+    if (stmt.kind == Stmt::Kind::Local){
+      Type_id local = type_table.primitive(stmt.local_type);
+      if (stmt.expr != -1 && type != local){
+	compiler_error(t, "Cannot assign `{}` to `{}` of type `{}`", type_table.name(type), t.value, type_table.name(local));
+      }
+      Symbol sym{Symbol::Kind::Local, int(func.args.size()) + func.ast.locals++, local};
+      if (!scope.declare(t.atom, sym)){
+	compiler_error(t, "`{}` is already declared in this scope", t.value);
+      }
+    }
+  }
+}
+
+#define CHECK_PARALLEL_MIN_FUNCTIONS 256
+
+// Checks every function body. A body depends only on itself and the global
+// signatures, so with `jobs` > 1 the bodies are spread over the worker pool
+// in ranges that idle threads split off and steal. Each function records
+// at most one error; the errors are then reported together in source order,
+// so the output does not depend on the number of threads or on scheduling.
+void check_functions(int jobs = 1){
+  mem::set_phase(mem::Phase::Check);
+  MEM_SITE("check_functions");
+  std::vector<std::string> errors(functions.size());
+  auto check_range = [&](size_t first, size_t last){
+    MEM_SITE("check_functions");
+    bool fatal = errors_are_fatal;
+    errors_are_fatal = false;
+    thread_local Checker checker;
+    for (size_t i = first; i < last; ++i){
+      if (functions[i].imported || functions[i].builtin != -1) continue;
+      try {
+	check_function(checker, functions[i]);
+      } catch (Compile_error& e){
+	errors[i] = std::move(e.message);
+      }
+    }
+    errors_are_fatal = fatal;
+  };
+
+  if (jobs > 1 && functions.size() >= CHECK_PARALLEL_MIN_FUNCTIONS){
+    job::parallel_for(workers(jobs), 0, functions.size(), check_range);
+  } else {
+    check_range(0, functions.size());
+  }
+
+  std::string report;
+  for (auto& e : errors) report += e;
+  if (!report.empty()) fatal_error(report);
+}
+
+// Dead functions --------------------------------------------------
+// Keeps only the functions reachable through calls from `main` and the
+// exported functions, so checking and emission scale with the code that
+// is used. Bodies are parsed as the walk reaches them, so a dropped
+// function's body is never parsed at all. Without any root (checking a
+// plain library file) every function is kept. With `folded`, after
+// fold_comptime(), calls that were folded into constants no longer keep
+// their callee: they are emitted as values.
+void eliminate_dead_functions(bool folded = false){
+  MEM_SITE("eliminate_dead_functions");
+  Atom main_atom = atoms.intern("main");
+  std::vector<bool> live(functions.size(), false);
+  std::vector<int> worklist;
+  auto mark = [&](int i){
+    if (live[i]) return;
+    live[i] = true;
+    worklist.push_back(i);
+  };
+  for (size_t i = 0; i < functions.size(); ++i){
+    if (functions[i].exported || (functions[i].name_atom == main_atom && !functions[i].imported)) mark(int(i));
+  }
+  if (worklist.empty()) return;
+
+  while (!worklist.empty()){
+    Function& func = functions[worklist.back()];
+    worklist.pop_back();
+    if (func.imported || func.builtin != -1) continue;
+    parse_body(func);
+    Tokens& body = func.block.tokens();
+    const Ast& ast = func.ast;
+    for (size_t n = 0; n < ast.exprs.size(); ++n){
+      const Expr& e = ast.exprs[n];
+      if (e.kind != Expr::Kind::Call) continue;
+      if (folded && !ast.consts.empty() && ast.consts[n].type != Value::Type::Void) continue;
+      // resolved in the global scope: a local shadowing a function at worst keeps it alive
+      Symbol* sym = symbols.lookup(body[e.token].atom);
+      if (sym && sym->kind == Symbol::Kind::Function) mark(sym->index);
+    }
+  }
+
+  std::vector<int> new_index(functions.size(), -1);
+  size_t kept = 0;
+  for (size_t i = 0; i < functions.size(); ++i){
+    if (!live[i]) continue;
+    new_index[i] = int(kept);
+    if (kept != i) functions[kept] = std::move(functions[i]);
+    kept++;
+  }
+  functions.erase(functions.begin() + kept, functions.end());
+  symbols.remap_functions(new_index);
+}
+
+// Compile-time evaluation --------------------------------------------------
+// A function is pure when its arguments, result, locals and every value in
+// its body are `int`, `float`, `char` or `bool`, and it calls only pure
+// functions. Calls to pure functions are interpreted inside the compiler:
+// after checking, every such call whose arguments are constants is
+// evaluated and emitted as its result, so the work is done once per compile
+// instead of once per run. `comptime expr` demands it: an expression that
+// cannot be evaluated is an error instead of being left to run time.
+//
+// The interpreter walks the checked statements of the callee and its nodes
+// in creation order, so operands are always evaluated first. Each call site
+// gets COMPTIME_FUEL evaluated nodes and calls may nest COMPTIME_MAX_DEPTH
+// deep; a call site that runs out of either runs at run time, as does one
+// that divides by zero, overflows, or makes an infinite or NaN float.
+// Results are memoized on the callee and its arguments for the whole
+// compile.
+
+#define COMPTIME_FUEL 1000000
+#define COMPTIME_MAX_DEPTH 256
+
+bool mul_overflows(int64_t x, int64_t y){
+  if (x == 0 || y == 0) return false;
+  uint64_t ux = x < 0 ? 0 - uint64_t(x) : uint64_t(x);
+  uint64_t uy = y < 0 ? 0 - uint64_t(y) : uint64_t(y);
+  uint64_t limit = (x < 0) != (y < 0) ? uint64_t(INT64_MAX) + 1 : uint64_t(INT64_MAX);
+  return ux > limit / uy;
+}
+
+struct Comptime {
+  struct Key_hash {
+    size_t operator()(const std::vector<int64_t>& key) const {
+      size_t h = 14695981039346656037ull;
+      for (int64_t k : key){
+	h = (h ^ uint64_t(k)) * 1099511628211ull;
+      }
+      return h;
+    }
+  };
+  enum Purity : int8_t { Unknown, Pure, Impure };
+
+  std::vector<int8_t> purity; // by function
+  std::unordered_map<std::vector<int64_t>, Constant, Key_hash> memo;     // callee, arguments
+  std::unordered_map<std::vector<int64_t>, std::string, Key_hash> failed; // call sites that cannot be evaluated
+  std::vector<Constant> stack; // per call: argument and local slots, then one value per node
+  std::vector<Constant> args;
+  int64_t fuel{0};
+  int depth{0};
+  std::string error; // why the last evaluation failed
+  // scratch of fold_function()
+  std::vector<int> blame; // by node that is not constant: the node that keeps it from being one
+  std::unordered_map<int, std::string> reasons; // by blamed node that failed to evaluate
+
+  bool fail(std::string message){
+    error = std::move(message);
+    return false;
+  }
+
+  // Whether the function's own body qualifies; its callees are checked when
+  // they are called, so cycles of calls need no special care.
+  bool pure(int index){
+    if (purity.empty()) purity.assign(functions.size(), Unknown);
+    if (purity[index] != Unknown) return purity[index] == Pure;
+    Function& func = functions[index];
+    bool res = func.builtin == -1 && !func.imported && func.ast.parsed && is_scalar(func.return_value.type);
+    for (size_t i = 0; res && i < func.args.size(); ++i) res = is_scalar(func.args[i].type);
+    for (size_t i = 0; res && i < func.ast.exprs.size(); ++i) res = is_scalar(func.ast.exprs[i].type);
+    purity[index] = res ? Pure : Impure;
+    return res;
+  }
+
+  // Applies the arithmetic of the Negate or Binary node `e` to constants.
+  bool apply(const Expr& e, const Token& t, Constant a, Constant b, Constant& res){
+    if (a.type == Value::Type::Float){
+      double x = a.as_float(), y = b.as_float();
+      if (e.kind == Expr::Kind::Negate){
+	res = Constant::of_float(-x);
+	return true;
+      }
+      double r = 0;
+      switch (e.op){
+      case Token::Type::Plus:  r = x + y; break;
+      case Token::Type::Minus: r = x - y; break;
+      case Token::Type::Mult:  r = x * y; break;
+      case Token::Type::Div:   r = x / y; break;
+      default: return fail(FMT("`{}` cannot be evaluated", t.value));
+      }
+      if (!std::isfinite(r)) return fail(FMT("`{}` gives {}, which has no C literal", t.value, r));
+      res = Constant::of_float(r);
+      return true;
+    }
+    int64_t x = a.bits, y = b.bits;
+    bool overflow = false;
+    int64_t r = 0;
+    if (e.kind == Expr::Kind::Negate){
+      overflow = x == INT64_MIN;
+      r = overflow ? 0 : -x;
+    } else {
+      switch (e.op){
+      case Token::Type::Plus: {
+	overflow = (y > 0 && x > INT64_MAX - y) || (y < 0 && x < INT64_MIN - y);
+	r = int64_t(uint64_t(x) + uint64_t(y));
+      } break;
+      case Token::Type::Minus: {
+	overflow = (y < 0 && x > INT64_MAX + y) || (y > 0 && x < INT64_MIN + y);
+	r = int64_t(uint64_t(x) - uint64_t(y));
+      } break;
+      case Token::Type::Mult: {
+	overflow = mul_overflows(x, y);
+	r = int64_t(uint64_t(x) * uint64_t(y));
+      } break;
+      case Token::Type::Div:
+      case Token::Type::Mod: {
+	if (y == 0) return fail(FMT("`{}` divides by zero", t.value));
+	overflow = x == INT64_MIN && y == -1;
+	if (!overflow) r = e.op == Token::Type::Div ? x / y : x % y;
+      } break;
+      default: return fail(FMT("`{}` cannot be evaluated", t.value));
+      }
+    }
+    if (overflow) return fail(FMT("`{}` overflows `int`", t.value));
+    res = {Value::Type::Int, r};
+    return true;
+  }
+
+  // The value of node `n`, whose frame keeps node values from `values` on;
+  // it must be set.
+  bool operand(const Function& func, Tokens& body, size_t values, int n, Constant& res){
+    res = stack[values + size_t(n)];
+    if (res.type != Value::Type::Void) return true;
+    return fail(FMT("`{}` is read before it is set", body[func.ast.exprs[n].token].value));
+  }
+
+  // Evaluates nodes first .. last of the call frame at `base`.
+  bool eval(const Function& func, Tokens& body, size_t base, int first, int last){
+    const Ast& ast = func.ast;
+    size_t values = base + func.args.size() + size_t(ast.locals);
+    for (int n = first; n <= last; ++n){
+      if (--fuel < 0) return fail(FMT("it takes more than {} steps", COMPTIME_FUEL));
+      const Expr& e = ast.exprs[n];
+      const Token& t = body[e.token];
+      Constant v, a, b;
+      switch (e.kind){
+      case Expr::Kind::Number: {
+	v = Constant::of_number(t);
+      } break;
+      case Expr::Kind::Char: {
+	v = {Value::Type::Char, int64_t(t.value[0])};
+      } break;
+      case Expr::Kind::Name: {
+	v = stack[base + size_t(e.a)];
+      } break;
+      case Expr::Kind::Call: {
+	int callee = symbols.lookup(t.atom)->index;
+	args.clear();
+	for (int i = e.a; i < e.a + e.b; ++i){
+	  if (!operand(func, body, values, ast.args[i], a)) return false;
+	  args.push_back(a);
+	}
+	if (!call(callee, v)) return false;
+      } break;
+      case Expr::Kind::Negate: {
+	if (!operand(func, body, values, e.a, a) || !apply(e, t, a, a, v)) return false;
+      } break;
+      case Expr::Kind::Comptime: {
+	if (!operand(func, body, values, e.a, v)) return false;
+      } break;
+      case Expr::Kind::Binary: {
+	if (!operand(func, body, values, e.b, b)) return false;
+	if (e.op == Token::Type::Equal){
+	  stack[base + size_t(ast.exprs[e.a].a)] = b;
+	  v = b;
+	} else if (!operand(func, body, values, e.a, a) || !apply(e, t, a, b, v)){
+	  return false;
+	}
+      } break;
+      default: {
+	return fail(FMT("`{}` cannot be evaluated", t.value));
+      } break;
+      }
+      stack[values + size_t(n)] = v;
+    }
+    return true;
+  }
+
+  // Calls `functions[index]` with `args`.
+  bool call(int index, Constant& res){
+    Function& func = functions[index];
+    if (!pure(index)) return fail(FMT("`{}` is not a pure function", func.name));
+    std::vector<int64_t> key{index};
+    for (auto& a : args) key.push_back(a.bits);
+    auto it = memo.find(key);
+    if (it != memo.end()){
+      res = it->second;
+      return true;
+    }
+    if (depth >= COMPTIME_MAX_DEPTH) return fail(FMT("calls nest more than {} deep", COMPTIME_MAX_DEPTH));
+
+    const Ast& ast = func.ast;
+    Tokens& body = func.block.tokens();
+    size_t base = stack.size();
+    stack.resize(base + func.args.size() + size_t(ast.locals) + ast.exprs.size());
+    std::copy(args.begin(), args.end(), stack.begin() + base);
+    depth++;
+    size_t local = base + func.args.size();
+    size_t values = local + size_t(ast.locals);
+    bool returned = false, ok = true;
+    for (const Stmt& stmt : ast.stmts){
+      if (stmt.kind == Stmt::Kind::Open_scope || stmt.kind == Stmt::Kind::Close_scope) continue;
+      Constant v;
+      if (stmt.expr != -1){
+	ok = eval(func, body, base, stmt.first, stmt.expr);
+	if (ok && stmt.kind != Stmt::Kind::Expr) ok = operand(func, body, values, stmt.expr, v);
+	if (!ok) break;
+      }
+      if (stmt.kind == Stmt::Kind::Local){
+	stack[local++] = v;
+      } else if (stmt.kind == Stmt::Kind::Return){
+	res = v;
+	returned = true;
+	break;
+      }
+    }
+    depth--;
+    stack.resize(base);
+    if (!ok) return false;
+    if (!returned) return fail(FMT("`{}` ends without returning a value", func.name));
+    memo.emplace(std::move(key), res);
+    return true;
+  }
+
+  // Evaluates a call site: `functions[index]` with `args`, on a full tank.
+  bool evaluate(int index, Constant& res){
+    std::vector<int64_t> key{index};
+    for (auto& a : args) key.push_back(a.bits);
+    auto it = failed.find(key);
+    if (it != failed.end()) return fail(it->second);
+    fuel = COMPTIME_FUEL;
+    depth = 0;
+    stack.clear();
+    bool ok = call(index, res);
+    if (!ok) failed.emplace(std::move(key), error);
+    return ok;
+  }
+};
+
+// Fills Ast::consts of a checked function: literals, arithmetic on
+// constants, and calls to pure functions with constant arguments that
+// evaluate. A `comptime` expression that is not constant is an error.
+void fold_function(Comptime& ct, Function& func){
+  Ast& ast = func.ast;
+  Tokens& body = func.block.tokens();
+  std::vector<int>& blame = ct.blame;
+  std::unordered_map<int, std::string>& reasons = ct.reasons;
+  ast.consts.assign(ast.exprs.size(), Constant{});
+  blame.assign(ast.exprs.size(), -1);
+  reasons.clear();
+  for (int n = 0; n < int(ast.exprs.size()); ++n){
+    Expr& e = ast.exprs[n];
+    Token& t = body[e.token];
+    Constant& v = ast.consts[n];
+    auto known = [&](int operand){
+      if (ast.consts[operand].type != Value::Type::Void) return true;
+      blame[n] = blame[operand];
+      return false;
+    };
+    auto failed = [&](){
+      blame[n] = n;
+      reasons[n] = std::move(ct.error);
+    };
+    switch (e.kind){
+    case Expr::Kind::Number: {
+      v = Constant::of_number(t);
+    } break;
+    case Expr::Kind::Char: {
+      v = {Value::Type::Char, int64_t(t.value[0])};
+    } break;
+    case Expr::Kind::Negate: {
+      if (known(e.a) && !ct.apply(e, t, ast.consts[e.a], ast.consts[e.a], v)) failed();
+    } break;
+    case Expr::Kind::Binary: {
+      if (e.op == Token::Type::Equal) blame[n] = n;
+      else if (known(e.a) && known(e.b) && !ct.apply(e, t, ast.consts[e.a], ast.consts[e.b], v)) failed();
+    } break;
+    case Expr::Kind::Call: {
+      ct.args.clear();
+      bool constant = true;
+      for (int i = e.a; constant && i < e.a + e.b; ++i){
+	constant = known(ast.args[i]);
+	ct.args.push_back(ast.consts[ast.args[i]]);
+      }
+      if (constant && !ct.evaluate(symbols.lookup(t.atom)->index, v)){
+	v = Constant{};
+	failed();
+      }
+    } break;
+    case Expr::Kind::Comptime: {
+      if (known(e.a)){
+	v = ast.consts[e.a];
+	break;
+      }
+      const Expr& culprit = ast.exprs[blame[n]];
+      std::string why = culprit.kind == Expr::Kind::Name ? FMT("`{}` is not known at compile time", body[culprit.token].value)
+	: culprit.kind == Expr::Kind::Binary && culprit.op == Token::Type::Equal ? "it assigns"
+	: culprit.kind == Expr::Kind::String ? "it uses a `str`"
+	: reasons[blame[n]];
+      compiler_error(t, "Cannot evaluate at compile time: {}", why);
+    } break;
+    default: {
+      blame[n] = n;
+    } break;
+    }
+  }
+}
+
+// Folds every function that was checked; as in check_functions(), each
+// reports at most one error, in source order. Functions that only folded
+// calls used are dropped afterwards.
+void fold_comptime(){
+  MEM_SITE("fold_comptime");
+  Comptime ct;
+  std::string report;
+  bool fatal = errors_are_fatal;
+  errors_are_fatal = false;
+  for (auto& func : functions){
+    if (func.imported || func.builtin != -1 || !func.ast.parsed) continue;
+    try {
+      fold_function(ct, func);
+    } catch (Compile_error& e){
+      report += e.message;
+    }
+  }
+  errors_are_fatal = fatal;
+  if (!report.empty()) fatal_error(report);
+  // a function every call of which was folded is no longer used
+  eliminate_dead_functions(true);
+}
+
+// Runtime --------------------------------------------------
+// Builtin functions are implemented by a small C runtime that is emitted
+// into every generated translation unit. Memory for `str` and `ptr` values
+// comes from a region: a function that may leave allocations in it takes a
+// mark on entry and resets the region to that mark when it returns, so its
+// temporaries are freed wholesale. A function returning `str` or `ptr`
+// keeps its allocations for the caller. Region blocks are kept after a
+// reset, and `new`/`delete` objects are recycled through size-class free
+// lists, so a program in a steady state does not call malloc.
+
+struct Builtin {
+  const char* name;
+  std::vector<Value::Type> args;
+  Value::Type ret;
+  bool region; // allocates in the caller's region
+};
+
+static const Builtin builtins[] = {
+  {"alloc",       {Value::Type::Int},                   Value::Type::Ptr,  true},
+  {"concat",      {Value::Type::Str, Value::Type::Str}, Value::Type::Str,  true},
+  {"new",         {Value::Type::Int},                   Value::Type::Ptr,  false},
+  {"delete",      {Value::Type::Ptr},                   Value::Type::Void, false},
+  {"memallocs",   {},                                   Value::Type::Int,  false},
+  {"memmallocs",  {},                                   Value::Type::Int,  false},
+  {"memused",     {},                                   Value::Type::Int,  false},
+  {"mempeak",     {},                                   Value::Type::Int,  false},
+};
+
+#define BUILTIN_PATH "<builtin>"
+
+// Declares the builtins in an outer scope of their own, before the prelude.
+void declare_builtins(){
+  MEM_SITE("declare_builtins");
+  symbols.push_scope();
+  for (int i = 0; i < int(std::size(builtins)); ++i){
+    const Builtin& b = builtins[i];
+    Function func;
+    func.name = b.name;
+    func.name_atom = atoms.intern(func.name);
+    for (Value::Type t : b.args) func.args.push_back(Value{t});
+    func.return_value = Value{b.ret};
+    func.type = type_table.function(func.args, func.return_value);
+    func.token.loc = {0, 0, BUILTIN_PATH};
+    func.token.value = func.name;
+    func.token.atom = func.name_atom;
+    func.builtin = i;
+    symbols.declare(func.name_atom, Symbol{Symbol::Kind::Function, int(functions.size()), func.type});
+    functions.push_back(std::move(func));
+  }
+}
+
+// Whether a call to `callee` may leave allocations in the caller's region.
+bool leaves_region_memory(const Function& callee){
+  if (callee.builtin != -1) return builtins[callee.builtin].region;
+  return callee.return_value.type == Value::Type::Str || callee.return_value.type == Value::Type::Ptr;
+}
+
+static const char* c_runtime_decls = R"c(#include <stdlib.h>
+#include <string.h>
+
+#define HASH_BLOCK_SIZE (64 * 1024)
+#define HASH_POOL_CLASSES 8 /* 32 .. 4096 bytes, header included */
+
+typedef struct hash_Block hash_Block;
+struct hash_Block {
+  hash_Block* next; /* kept after a reset for reuse */
+  size_t size;
+  char data[];
+};
+
+typedef struct {
+  hash_Block* block;
+  char* cur;
+  int64_t used;
+} hash_Mark;
+
+typedef struct {
+  hash_Block* first;
+  hash_Block* block;
+  char* cur;
+  char* end;
+  int64_t used;
+} hash_Region;
+
+typedef struct {
+  int64_t allocs;  /* alloc(), concat() and new() calls */
+  int64_t mallocs; /* times the runtime asked malloc for memory */
+  int64_t pooled;  /* bytes held by live new() objects */
+  int64_t peak;    /* most bytes in use at once */
+} hash_Stats;
+
+extern hash_Region hash_region;
+extern hash_Stats hash_stats;
+void* hash_region_grow(size_t size);
+void* hash_new(int64_t size);
+void hash_delete(void* p);
+
+static inline void hash_count_alloc(void) {
+  int64_t in_use = hash_region.used + hash_stats.pooled;
+  hash_stats.allocs++;
+  if (in_use > hash_stats.peak) hash_stats.peak = in_use;
+}
+
+static inline hash_Mark hash_region_mark(void) {
+  hash_Mark m = {hash_region.block, hash_region.cur, hash_region.used};
+  return m;
+}
+
+static inline void hash_region_reset(hash_Mark m) {
+  hash_region.block = m.block;
+  hash_region.cur = m.cur;
+  hash_region.end = m.block ? m.block->data + m.block->size : m.cur;
+  hash_region.used = m.used;
+}
+
+static inline void* hash_alloc(int64_t size) {
+  size_t n = size > 0 ? ((size_t)size + 15) & ~(size_t)15 : 16;
+  void* p;
+  if ((size_t)(hash_region.end - hash_region.cur) >= n) {
+    p = hash_region.cur;
+    hash_region.cur += n;
+  } else {
+    p = hash_region_grow(n);
+  }
+  hash_region.used += (int64_t)n;
+  hash_count_alloc();
+  return p;
+}
+
+static inline const char* hash_concat(const char* a, const char* b) {
+  size_t la = strlen(a), lb = strlen(b);
+  char* res = (char*)hash_alloc((int64_t)(la + lb + 1));
+  memcpy(res, a, la);
+  memcpy(res + la, b, lb + 1);
+  return res;
+}
+
+static inline int64_t hash_memallocs(void) { return hash_stats.allocs; }
+static inline int64_t hash_memmallocs(void) { return hash_stats.mallocs; }
+static inline int64_t hash_memused(void) { return hash_region.used + hash_stats.pooled; }
+static inline int64_t hash_mempeak(void) { return hash_stats.peak; }
+)c";
+
+// Defined once, in the translation unit that holds `main`.
+static const char* c_runtime_impl = R"c(
+hash_Region hash_region;
+hash_Stats hash_stats;
+
+/* Moves the region to the next block that fits `size` bytes, reusing the
+   blocks kept by earlier resets. */
+void* hash_region_grow(size_t size) {
+  hash_Block* next = hash_region.block ? hash_region.block->next : hash_region.first;
+  if (!next || next->size < size) {
+    size_t cap = size > HASH_BLOCK_SIZE ? size : HASH_BLOCK_SIZE;
+    hash_Block* b = (hash_Block*)malloc(sizeof(hash_Block) + cap);
+    if (!b) abort();
+    hash_stats.mallocs++;
+    b->size = cap;
+    b->next = next;
+    if (hash_region.block) hash_region.block->next = b;
+    else hash_region.first = b;
+    next = b;
+  }
+  hash_region.block = next;
+  hash_region.cur = next->data + size;
+  hash_region.end = next->data + next->size;
+  return next->data;
+}
+
+/* Every new() object follows a 16 byte header holding its size class (or
+   HASH_POOL_CLASSES when it is too big for a pool) and its size. */
+typedef struct hash_Free { struct hash_Free* next; } hash_Free;
+static hash_Free* hash_pool[HASH_POOL_CLASSES];
+static char* hash_slab_cur;
+static char* hash_slab_end;
+
+void* hash_new(int64_t size) {
+  size_t n = (size_t)(size > 0 ? size : 0) + 16;
+  int k = 0;
+  while (k < HASH_POOL_CLASSES && ((size_t)32 << k) < n) k++;
+  int64_t* h;
+  if (k == HASH_POOL_CLASSES) {
+    h = (int64_t*)malloc(n);
+    if (!h) abort();
+    hash_stats.mallocs++;
+    h[1] = (int64_t)n;
+  } else {
+    size_t cls = (size_t)32 << k;
+    if (hash_pool[k]) {
+      h = (int64_t*)hash_pool[k];
+      hash_pool[k] = hash_pool[k]->next;
+    } else {
+      if ((size_t)(hash_slab_end - hash_slab_cur) < cls) {
+        hash_slab_cur = (char*)malloc(HASH_BLOCK_SIZE);
+        if (!hash_slab_cur) abort();
+        hash_stats.mallocs++;
+        hash_slab_end = hash_slab_cur + HASH_BLOCK_SIZE;
+      }
+      h = (int64_t*)hash_slab_cur;
+      hash_slab_cur += cls;
+    }
+    h[1] = (int64_t)cls;
+  }
+  h[0] = k;
+  hash_stats.pooled += h[1];
+  hash_count_alloc();
+  memset(h + 2, 0, n - 16);
+  return h + 2;
+}
+
+void hash_delete(void* p) {
+  if (!p) return;
+  int64_t* h = (int64_t*)p - 2;
+  int k = (int)h[0];
+  hash_stats.pooled -= h[1];
+  if (k == HASH_POOL_CLASSES) {
+    free(h);
+    return;
+  }
+  hash_Free* f = (hash_Free*)h;
+  f->next = hash_pool[k];
+  hash_pool[k] = f;
+}
+)c";
+
+// C backend --------------------------------------------------
+// Lowers the checked functions into one readable C11 translation unit and
+// hands it to the system C compiler, which does the heavy optimization.
+
+// Every user name becomes `hash_n_` followed by its bytes, with everything
+// but ASCII letters and digits written as `_xx` in hex, so no two names map
+// to the same C name and none can collide with C keywords, the runtime or
+// what the libc headers declare (`div`, `free`, `errno`, ...).
+std::string c_name(const std::string& name){
+  std::string res = "hash_n_";
+  for (char c : name){
+    if (lex_isalpha(c) || lex_isdigit(c)) res += c;
+    else res += FMT("_{:02x}", uint8_t(c));
+  }
+  return res;
+}
+
+std::string c_type(Value::Type type){
+  switch (type){
+  case Value::Type::Int:   return "int64_t";
+  case Value::Type::Float: return "double";
+  case Value::Type::Ptr:   return "void*";
+  case Value::Type::Char:  return "char";
+  case Value::Type::Str:   return "const char*";
+  case Value::Type::Bool:  return "bool";
+  case Value::Type::Void:  return "void";
+  default: {
+    UNREACHABLE();
+  } break;
+  }
+  return {};
+}
+
+std::string c_escape(const std::string& s, char quote){
+  std::string res;
+  for (char c : s){
+    if (c == '\\' || c == quote) res += '\\';
+    res += c;
+  }
+  return res;
+}
+
+// A C expression for a folded value, parenthesized when negative so it can
+// stand anywhere an operand can. An `int` is written with INT64_C, since a
+// bare literal is only a 32-bit `int` in C and arithmetic on it overflows.
+std::string c_constant(const Constant& c){
+  switch (c.type){
+  case Value::Type::Int: {
+    if (c.bits == INT64_MIN) return "INT64_MIN";
+    return c.bits < 0 ? FMT("(-INT64_C({}))", -c.bits) : FMT("INT64_C({})", c.bits);
+  } break;
+  case Value::Type::Float: {
+    std::string res = FMT("{}", c.as_float()); // shortest form that reads back exactly
+    if (res.find_first_of(".e") == std::string::npos) res += ".0";
+    return res[0] == '-' ? FMT("({})", res) : res;
+  } break;
+  case Value::Type::Char: {
+    char ch = char(c.bits);
+    if (ch >= ' ' && ch <= '~') return FMT("'{}'", c_escape(std::string(1, ch), '\''));
+    return FMT("((char){})", c.bits);
+  } break;
+  case Value::Type::Bool: {
+    return c.bits ? "true" : "false";
+  } break;
+  default: {
+    UNREACHABLE();
+  } break;
+  }
+  return {};
+}
+
+// The C function that implements `func`.
+std::string c_callee(const Function& func){
+  if (func.builtin != -1) return FMT("hash_{}", func.name);
+  return c_name(func.name);
+}
+
+std::string c_signature(const Function& func){
+  bool is_static = !func.exported && !func.imported;
+  std::string res = FMT("{}{} {}(", is_static ? "static " : "", c_type(func.return_value.type), c_name(func.name));
+  if (func.args.empty()) res += "void";
+  for (size_t i = 0; i < func.args.size(); ++i){
+    if (i > 0) res += ", ";
+    res += FMT("{} {}", c_type(func.args[i].type), c_name(func.arg_tokens[i].value));
+  }
+  return res + ")";
+}
+
+// Whether the operand `child` of `parent` needs parentheses in C, whose
+// precedence and associativity for these operators match ours.
+bool c_needs_parens(const Expr& parent, const Expr& child, bool rhs){
+  if (child.kind != Expr::Kind::Binary && child.kind != Expr::Kind::Negate) return false;
+  if (parent.kind == Expr::Kind::Negate) return true;
+  int p = expr_prec(parent), c = expr_prec(child);
+  if (c != p) return c < p;
+  return rhs != binary_ops[int(parent.op)].right_assoc;
+}
+
+// Writes the expression rooted at `root` with an explicit stack: each frame
+// is a node and how many of its operands have been written so far.
+void emit_c_expr(std::string& out, const Ast& ast, Tokens& body, int root){
+  struct Frame {
+    int node;
+    int state;
+  };
+  std::vector<Frame> stack{{root, 0}};
+  while (!stack.empty()){
+    Frame f = stack.back();
+    const Expr& e = ast.exprs[f.node];
+    Token& t = body[e.token];
+    // whatever fold_comptime() folded is written as its value
+    if (f.state == 0 && !ast.consts.empty() && ast.consts[f.node].type != Value::Type::Void){
+      out += c_constant(ast.consts[f.node]);
+      stack.pop_back();
+      continue;
+    }
+    switch (e.kind){
+    case Expr::Kind::Number: {
+      out += c_constant(Constant::of_number(t));
+      stack.pop_back();
+    } break;
+    case Expr::Kind::String: {
+      out += FMT("\"{}\"", c_escape(t.value, '"'));
+      stack.pop_back();
+    } break;
+    case Expr::Kind::Char: {
+      out += FMT("'{}'", c_escape(t.value, '\''));
+      stack.pop_back();
+    } break;
+    case Expr::Kind::Name: {
+      out += c_name(t.value);
+      stack.pop_back();
+    } break;
+    case Expr::Kind::Call:
+    case Expr::Kind::Comptime: {
+      if (e.kind == Expr::Kind::Comptime){
+	stack.back() = {e.a, 0};
+	break;
+      }
+      if (f.state == 0) out += c_callee(functions[symbols.lookup(t.atom)->index]) + "(";
+      if (f.state < e.b){
+	if (f.state > 0) out += ", ";
+	stack.back().state++;
+	stack.push_back({ast.args[e.a + f.state], 0});
+      } else {
+	out += ")";
+	stack.pop_back();
+      }
+    } break;
+    case Expr::Kind::Negate: {
+      bool parens = c_needs_parens(e, ast.exprs[e.a], false);
+      if (f.state == 0){
+	out += parens ? "-(" : "-";
+	stack.back().state++;
+	stack.push_back({e.a, 0});
+      } else {
+	if (parens) out += ")";
+	stack.pop_back();
+      }
+    } break;
+    case Expr::Kind::Binary: {
+      bool lparens = c_needs_parens(e, ast.exprs[e.a], false);
+      bool rparens = c_needs_parens(e, ast.exprs[e.b], true);
+      if (f.state == 0){
+	if (lparens) out += "(";
+	stack.back().state++;
+	stack.push_back({e.a, 0});
+      } else if (f.state == 1){
+	if (lparens) out += ")";
+	out += FMT(" {} ", t.value);
+	if (rparens) out += "(";
+	stack.back().state++;
+	stack.push_back({e.b, 0});
+      } else {
+	if (rparens) out += ")";
+	stack.pop_back();
+      }
+    } break;
+    default: {
+      UNREACHABLE();
+    } break;
+    }
+  }
+}
+
+// One C statement per parsed statement; `name: type` becomes a C declaration.
+// A function that may leave allocations in the region resets it to the mark
+// it took on entry before every return.
+void emit_c_body(std::string& out, Function& func){
+  Tokens& body = func.block.tokens();
+  const Ast& ast = func.ast;
+  int indent = 1;
+  bool region = false;
+  if (!leaves_region_memory(func)){
+    for (const Expr& e : ast.exprs){
+      if (e.kind == Expr::Kind::Call && leaves_region_memory(functions[symbols.lookup(body[e.token].atom)->index])){
+	region = true;
+	break;
+      }
+    }
+  }
+  if (region) out += "  hash_Mark hash_mark = hash_region_mark();\n";
+  for (const Stmt& stmt : ast.stmts){
+    if (stmt.kind == Stmt::Kind::Open_scope){
+      out.append(size_t(indent++) * 2, ' ');
+      out += "{\n";
+      continue;
+    }
+    if (stmt.kind == Stmt::Kind::Close_scope){
+      out.append(size_t(--indent) * 2, ' ');
+      out += "}\n";
+      continue;
+    }
+    out.append(size_t(indent) * 2, ' ');
+    if (region && stmt.kind == Stmt::Kind::Return){
+      if (stmt.expr == -1){
+	out += "hash_region_reset(hash_mark);\n";
+	out.append(size_t(indent) * 2, ' ');
+	out += "return;\n";
+      } else {
+	out += FMT("{{ {} hash_result = ", c_type(func.return_value.type));
+	emit_c_expr(out, ast, body, stmt.expr);
+	out += "; hash_region_reset(hash_mark); return hash_result; }\n";
+      }
+      continue;
+    }
+    switch (stmt.kind){
+    case Stmt::Kind::Return: {
+      out += stmt.expr != -1 ? "return " : "return";
+    } break;
+    case Stmt::Kind::Local: {
+      out += FMT("{} {}", c_type(stmt.local_type), c_name(body[stmt.token].value));
+      if (stmt.expr != -1) out += " = ";
+    } break;
+    case Stmt::Kind::Expr: {
+    } break;
+    default: {
+      UNREACHABLE();
+    } break;
+    }
+    if (stmt.expr != -1) emit_c_expr(out, ast, body, stmt.expr);
+    out += ";\n";
+  }
+  if (region) out += "  hash_region_reset(hash_mark);\n";
+}
+
+std::string emit_c(){
+  Symbol* main_sym = symbols.lookup(atoms.intern("main"));
+  bool has_main = main_sym && main_sym->kind == Symbol::Kind::Function;
+  std::string out = "// Generated by the hash compiler.\n#include <stdint.h>\n#include <stdbool.h>\n";
+  out += c_runtime_decls;
+  if (has_main) out += c_runtime_impl;
+  out += "\n";
+  for (auto& func : functions){
+    if (func.builtin != -1) continue;
+    out += c_signature(func) + ";\n";
+  }
+  for (auto& func : functions){
+    if (func.imported || func.builtin != -1) continue;
+    out += FMT("\n{} {{\n", c_signature(func));
+    emit_c_body(out, func);
+    out += "}\n";
+  }
+
+  if (has_main){
+    Function& main_func = functions[main_sym->index];
+    if (!main_func.args.empty()){
+      compiler_error(main_func.token, "`main` must not take arguments");
+    }
+    if (main_func.return_value.type == Value::Type::Void){
+      out += FMT("\nint main(void) {{\n  {}();\n  return 0;\n}}\n", c_name("main"));
+    } else {
+      out += FMT("\nint main(void) {{\n  return (int){}();\n}}\n", c_name("main"));
+    }
+  }
+  return out;
+}
+
+// Writes `exe`.c and returns the command that compiles it with $CC (default
+// `cc`) at -O2.
+std::vector<std::string> c_compile_command(const std::string& exe){
+  Symbol* main_sym = symbols.lookup(atoms.intern("main"));
+  if (!main_sym || main_sym->kind != Symbol::Kind::Function){
+    fatal_error("ERROR: Cannot build an executable without a `main` function\n");
+  }
+  std::string c_file = exe + ".c";
+  std::ofstream ofs(c_file, std::ios::binary);
+  ofs << emit_c();
+  ofs.close();
+
+  // $CC may carry flags of its own, e.g. "clang -m64"
+  const char* cc = std::getenv("CC");
+  std::vector<std::string> args;
+  std::string_view words = cc && *cc ? cc : "cc";
+  while (!words.empty()){
+    size_t end = std::min(words.find(' '), words.size());
+    if (end > 0) args.emplace_back(words.substr(0, end));
+    words.remove_prefix(std::min(end + 1, words.size()));
+  }
+  for (std::string a : {"-std=c11", "-O2", "-o"}) args.push_back(a);
+  args.push_back(exe);
+  args.push_back(c_file);
+  for (auto& module : imported_modules){
+    args.push_back(module.c_path);
+  }
+  return args;
+}
+
+// Compiles the program to `exe`. With `log`, the command and the C
+// compiler's messages are collected there instead of being printed.
+int build_executable(const std::string& exe, std::string* log = nullptr){
+  std::vector<std::string> args = c_compile_command(exe);
+  if (log){
+    *log += FMT("[CMD] {}\n", command_line(args));
+  } else {
+    print("[CMD] {}\n", command_line(args));
+  }
+  int status = run_process(args, log);
+  if (status != 0){
+    std::string message = FMT("ERROR: C compiler failed with status {}\n", status);
+    if (log){
+      *log += message;
+    } else {
+      fprint(std::cerr, "{}", message);
+    }
+    return 1;
+  }
+  return 0;
+}
+
+// Everything parse_tokens() and the passes after it produce. The other
+// tables (atoms, type_table) only ever grow, so they need no saving.
+struct Program {
+  std::vector<Function> functions;
+  Symbol_table symbols;
+  std::vector<Module> imported_modules;
+};
+
+// Moves the current program out, leaving an empty one.
+Program take_program(){
+  Program res{std::move(functions), std::move(symbols), std::move(imported_modules)};
+  functions.clear();
+  symbols = Symbol_table{};
+  imported_modules.clear();
+  return res;
+}
+
+void load_program(Program program){
+  functions = std::move(program.functions);
+  symbols = std::move(program.symbols);
+  imported_modules = std::move(program.imported_modules);
+}
+
+#define DAEMON_SOCKET ".hash-daemon.sock"
+#define DAEMON_CLIENT_TIMEOUT_MS 5000 // a client silent for this long is dropped
+
+#if defined(__linux__)
+#include <cstring>
+#include <sys/inotify.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <unistd.h>
+
+// Keeps the tokens, the checked functions and the check result of every
+// requested file in memory and answers requests from `hash --client` over a
+// Unix domain socket. The builtins and the prelude are parsed once, and
+// every file starts from a copy of them. inotify drops a file's cached
+// state when it changes on disk, and the checks of every file importing it.
+// An editor can also send its unsaved edits, which are relexed
+// incrementally. A check then parses again only the units (runs of pieces
+// between top-level items) whose text changed, checks again the functions
+// that changed, or all of them when a signature did, and folds again what
+// changed and the functions calling it, so it costs what the edit touched
+// rather than the whole file. Files are keyed by their canonical path.
+//
+// Protocol: the client sends "<command> <absolute path>\n" and shuts down
+// its side of the connection; the daemon answers "<exit status>\n<output>"
+// and closes it. An `edit` request goes on with "<offset> <removed>\n",
+// counted in bytes of the file as it is on disk, and the inserted text, and
+// is answered like `check`. A `compile` request may
+// go on with the absolute path of the executable; it defaults to the source
+// path without its extension. Clients are read and written without blocking,
+// next to the inotify events, so a slow or stuck client cannot hold up the
+// others. The C compiler and the builds of stale modules run as child
+// processes whose output is polled with the rest; a client waiting for one
+// is answered when it exits, and the others are served meanwhile.
+struct Daemon {
+  // What the checks of a file found out about one of its functions, kept
+  // while the function's unit is unchanged.
+  struct Function_state {
+    int row{1};               // the row its unit started at when its tokens were made
+    bool parsed{false};       // its body, into `calls` or `parse_error`
+    std::vector<Atom> calls;  // the callee of every call, in body order
+    uint64_t checked{0};      // the hash of the signatures it was checked against, 0 for none
+    bool folded{false};
+    std::string parse_error;
+    std::string check_error;
+    std::string fold_error;
+  };
+
+  // A run of whole pieces of a file that starts and ends between top-level
+  // items, so it parses on its own. It is parsed again only when one of its
+  // pieces changes.
+  struct Unit {
+    std::vector<uint64_t> versions; // of its pieces
+    int row{1};                     // the row it starts at
+    int parsed_row{1};              // `row` when `imports` and `error` were made
+    std::string error;              // from parsing it
+    std::vector<Function> functions;
+    std::vector<Function_state> states; // by function
+    std::vector<std::pair<size_t, Token>> imports; // as parse_tokens() defers them
+  };
+
+  struct Cached_file {
+    Edit_buffer source; // with every edit applied
+    bool lexed{false};
+    bool checked{false};
+    int status{0};
+    std::string output;
+    Unit prelude; // the builtins and the prelude, as this file's checks left them
+    std::vector<Unit> units;
+    std::vector<std::string> imports; // canonical source paths, as of the last check
+  };
+
+  // Where a function of the linked program goes back to: none for the
+  // functions of imported modules.
+  struct Owner {
+    Unit* unit{nullptr};
+    size_t index{0};
+  };
+
+  struct Client {
+    int fd{-1};
+    std::string request{};
+    std::string response{};
+    size_t sent{0};
+    bool answered{false}; // the request is complete and `response` is set
+    bool done{false};
+    std::chrono::steady_clock::time_point deadline{};
+    // the parsed request, kept to answer it again once a build it waits for exits
+    std::string command{};
+    std::string path{};
+    std::string exe{};    // of a `compile`
+    bool waiting{false};  // for a build; it is not timed out meanwhile
+    std::string module{}; // the source path of the module build it waits for
+  };
+
+  // A child process running without the daemon waiting for it: the C
+  // compiler for a `compile` or `hash --module` for a stale import.
+  struct Build {
+    pid_t pid{-1};
+    int fd{-1}; // its stdout and stderr
+    std::string output{};
+    std::string module{}; // the source path of a module build
+    int client{-1};       // the fd of the client a compile answers
+    bool exited{false};
+    int status{0};
+  };
+
+  Program prelude; // the builtins and the prelude, parsed
+  Checker checker;
+  std::vector<Client> clients;
+  std::vector<Build> builds;
+  // exit statuses of finished module builds, while their clients are answered
+  std::unordered_map<std::string, int> built_modules;
+
+  std::unordered_map<std::string, Cached_file> files;
+  std::unordered_map<int, std::string> watched_dirs;
+  std::unordered_set<std::string> watched_paths; // the values of `watched_dirs`
+  int inotify_fd{-1};
+  int server_fd{-1};
+  bool running{true};
+
+  void watch_tree(const std::string& root){
+    watch_dir(root);
+    std::error_code ec;
+    for (auto it = fs::recursive_directory_iterator(root, fs::directory_options::skip_permission_denied, ec);
+	 it != fs::recursive_directory_iterator(); it.increment(ec)){
+      if (it->is_directory(ec)){
+	if (it->path().filename().string().starts_with(".")){
+	  it.disable_recursion_pending();
+	  continue;
+	}
+	watch_dir(it->path().string());
+      }
+    }
+  }
+
+  void watch_dir(const std::string& dir){
+    if (watched_paths.contains(dir)) return;
+    int wd = inotify_add_watch(inotify_fd, dir.c_str(),
+			       IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE | IN_CREATE | IN_DELETE_SELF);
+    if (wd < 0){
+      fprint(std::cerr, "WARNING: Could not watch `{}`: {}\n", dir, strerror(errno));
+      return;
+    }
+    watched_dirs[wd] = dir;
+    watched_paths.insert(dir);
+  }
+
+  static std::string canonical(const std::string& path){
+    std::error_code ec;
+    fs::path res = fs::weakly_canonical(fs::path(path), ec);
+    return ec ? path : res.string();
+  }
+
+  // Drops the checks of every cached file that imports `path`, directly or
+  // through another cached file. Their tokens stay valid.
+  void invalidate_importers(const std::string& path){
+    std::vector<std::string> changed{path};
+    while (!changed.empty()){
+      std::string dep = std::move(changed.back());
+      changed.pop_back();
+      for (auto& [importer, file] : files){
+	if (!file.checked || std::find(file.imports.begin(), file.imports.end(), dep) == file.imports.end()) continue;
+	file.checked = false;
+	changed.push_back(importer);
+      }
+    }
+  }
+
+  void handle_fs_events(){
+    alignas(inotify_event) char buf[16 * 1024];
+    ssize_t n = read(inotify_fd, buf, sizeof(buf));
+    for (ssize_t off = 0; off < n; ){
+      inotify_event* ev = (inotify_event*)(buf + off);
+      off += sizeof(inotify_event) + ev->len;
+
+      if (ev->mask & IN_Q_OVERFLOW){
+	files.clear();
+	continue;
+      }
+      if (ev->mask & IN_IGNORED){
+	auto dir = watched_dirs.find(ev->wd);
+	if (dir != watched_dirs.end()){
+	  watched_paths.erase(dir->second);
+	  watched_dirs.erase(dir);
+	}
+	continue;
+      }
+      auto dir = watched_dirs.find(ev->wd);
+      if (dir == watched_dirs.end() || ev->len == 0) continue;
+      std::string path = (fs::path(dir->second) / ev->name).string();
+      if ((ev->mask & IN_ISDIR) && (ev->mask & (IN_CREATE | IN_MOVED_TO))){
+	watch_tree(path);
+      } else if (str::rpop_until(path, '.') == FILE_EXT){
+	path = canonical(path);
+	files.erase(path);
+	invalidate_importers(path);
+      }
+    }
+  }
+
+  void fail(Cached_file& file, const Compile_error& e){
+    file.checked = true;
+    file.status = 1;
+    file.output = e.message;
+  }
+
+  // Applies an edit that is in range to the file's text and tokens. The
+  // text takes the edit even when it does not lex; the check then reports
+  // the first lex error of the file, which may be in another piece.
+  void apply_edit(Cached_file& file, const std::string& path, size_t offset, size_t removed, std::string_view inserted){
+    file.checked = false;
+    try {
+      file.source.edit(offset, removed, inserted);
+    } catch (Compile_error&){
+    }
+    // the tokens hold every body, so nothing needs the source text anymore
+    sources.erase(path);
+  }
+
+  // The cached state of `path`, lexed from disk if it is not yet.
+  Cached_file& load_file(const std::string& path){
+    Cached_file& file = files[path];
+    // files outside the daemon's tree are watched once requested
+    watch_dir(fs::path(path).parent_path().string());
+    if (!file.lexed){
+      file.lexed = true;
+      file.checked = false;
+      Tokens tokens;
+      bool lexed = true;
+      try {
+	tokens = parse_source_file(path);
+      } catch (Compile_error& e){
+	lexed = false;
+	// a lex error is reported again by the check, which lexes its piece
+	// again; a file that could not be read has no pieces to lex
+	if (!sources.contains(path)) fail(file, e);
+      }
+      auto source = sources.find(path);
+      file.source.assign(path, source != sources.end() ? *source->second : "", std::move(tokens), lexed);
+      // the tokens hold every body, so nothing needs the source text
+      sources.erase(path);
+    }
+    return file;
+  }
+
+  static bool starts_item(const Token& token){
+    if (token.type != Token::Type::Name || !is_keyword(token.atom)) return false;
+    Keyword keyword = keywords.at(token.atom);
+    return keyword == Keyword::Func || keyword == Keyword::Import || keyword == Keyword::Export;
+  }
+
+  // Parses the tokens of a unit on their own, deferring its imports. The
+  // program is empty here.
+  static void parse_unit(Unit& unit, Tokens tokens){
+    unit.parsed_row = unit.row;
+    unit.error.clear();
+    unit.imports.clear();
+    try {
+      parse_tokens(tokens, &unit.imports);
+    } catch (Compile_error& e){
+      unit.error = std::move(e.message);
+    }
+    unit.functions = take_program().functions;
+    Function_state state;
+    state.row = unit.row;
+    unit.states.assign(unit.functions.size(), state);
+  }
+
+  // Cuts the file into units at the piece boundaries that fall between
+  // top-level items, keeping the units whose pieces are unchanged and
+  // parsing the others.
+  void update_units(Cached_file& file){
+    const Edit_buffer& source = file.source;
+    std::unordered_map<uint64_t, size_t> old; // by the version of the first piece
+    for (size_t i = 0; i < file.units.size(); ++i) old[file.units[i].versions.front()] = i;
+    std::vector<Unit> units;
+    std::vector<uint64_t> versions;
+    size_t first = 0, offset = 0, unit_offset = 0;
+    int row = 1, unit_row = 1, depth = 0;
+    const Token* last = nullptr;
+    for (size_t i = 0; i < source.pieces.size(); ++i){
+      const Edit_buffer::Piece& piece = source.pieces[i];
+      versions.push_back(piece.version);
+      depth += piece.depth;
+      if (!piece.tokens.empty()) last = &piece.tokens.back();
+      offset += piece.text.size();
+      row += piece.lines;
+      if (i + 1 < source.pieces.size()){
+	const Tokens& next = source.pieces[i + 1].tokens;
+	bool between_items = depth == 0 && last && !next.empty() && starts_item(next.front()) &&
+	  (last->type == Token::Type::Close_curl || last->type == Token::Type::Semi_colon);
+	if (!between_items) continue;
+      }
+
+      Unit unit;
+      auto it = old.find(versions.front());
+      if (it != old.end() && file.units[it->second].versions == versions){
+	unit = std::move(file.units[it->second]);
+	int moved = unit_row - unit.parsed_row;
+	unit.row = unit_row;
+	if (moved != 0 && !unit.error.empty()){
+	  // the error counts rows from where the unit was
+	  parse_unit(unit, source.tokens(first, i + 1, unit_offset, unit_row));
+	} else if (moved != 0){
+	  for (auto& import : unit.imports) import.second.loc.row += moved;
+	  unit.parsed_row = unit_row;
+	}
+      } else {
+	unit.versions = versions;
+	unit.row = unit_row;
+	parse_unit(unit, source.tokens(first, i + 1, unit_offset, unit_row));
+      }
+      units.push_back(std::move(unit));
+      versions.clear();
+      first = i + 1;
+      unit_offset = offset;
+      unit_row = row;
+    }
+    file.units = std::move(units);
+  }
+
+  // Moves the tokens of a function whose unit has moved to the unit's
+  // `row`. Its errors count rows from where it was, so what failed is done
+  // again.
+  static void catch_up(Function& func, Function_state& state, int row){
+    if (state.row == row) return;
+    int moved = row - state.row;
+    state.row = row;
+    func.token.loc.row += moved;
+    for (auto& token : func.arg_tokens) token.loc.row += moved;
+    for (auto& token : func.block._tokens) token.loc.row += moved;
+    func.block.start.row += moved;
+    if (!state.parse_error.empty()){
+      state.parse_error.clear();
+      state.parsed = false;
+      state.calls.clear();
+      func.ast = Ast{};
+    }
+    if (!state.check_error.empty()){
+      state.check_error.clear();
+      state.checked = 0;
+    }
+    if (!state.fold_error.empty()){
+      state.fold_error.clear();
+      state.folded = false;
+    }
+  }
+
+  // Links the prelude and the units of the file into the program the way
+  // parse_tokens() builds it for the whole file: functions are declared and
+  // modules imported in source order, and the first error is thrown. The
+  // functions are moved into `functions`, and `owners` records where each
+  // goes back to.
+  void link_program(Cached_file& file, std::vector<Owner>& owners){
+    if (file.prelude.states.empty()){
+      file.prelude.functions = prelude.functions;
+      file.prelude.states.resize(file.prelude.functions.size());
+    }
+    symbols = prelude.symbols;
+    for (size_t i = 0; i < file.prelude.functions.size(); ++i){
+      owners.push_back({&file.prelude, i});
+      functions.push_back(std::move(file.prelude.functions[i]));
+    }
+    symbols.push_scope(); // the global scope parse_tokens() opens
+    for (auto& unit : file.units){
+      if (!unit.error.empty()) fatal_error(unit.error);
+      size_t next = 0;
+      for (size_t i = 0; i <= unit.functions.size(); ++i){
+	for (; next < unit.imports.size() && unit.imports[next].first == i; ++next){
+	  import_module(unit.imports[next].second);
+	  owners.resize(functions.size());
+	}
+	if (i == unit.functions.size()) break;
+	Function& func = unit.functions[i];
+	if (!symbols.declare(func.name_atom, Symbol{Symbol::Kind::Function, int(functions.size()), func.type})){
+	  catch_up(func, unit.states[i], unit.row);
+	  compiler_error(func.token, "Function `{}` is already defined", func.name);
+	}
+	owners.push_back({&unit, i});
+	functions.push_back(std::move(func));
+      }
+    }
+  }
+
+  // Moves the functions back to their units and empties the program.
+  static void unlink_program(std::vector<Owner>& owners){
+    owners.resize(functions.size());
+    for (size_t i = 0; i < owners.size(); ++i){
+      if (owners[i].unit) owners[i].unit->functions[owners[i].index] = std::move(functions[i]);
+    }
+    take_program();
+  }
+
+  // Does what eliminate_dead_functions(), check_functions() and
+  // fold_comptime() do for the linked program, keeping every result that
+  // is still current. Throws the errors as they would.
+  void check_linked(std::vector<Owner>& owners){
+    size_t n = functions.size();
+    auto state = [&](size_t i) -> Function_state& { return owners[i].unit->states[owners[i].index]; };
+    auto skipped = [&](size_t i){ return functions[i].imported || functions[i].builtin != -1; };
+
+    uint64_t signatures = 14695981039346656037ull;
+    for (size_t i = prelude.functions.size(); i < n; ++i){
+      signatures = (signatures ^ uint64_t(functions[i].name_atom)) * 1099511628211ull;
+      signatures = (signatures ^ uint64_t(uint32_t(functions[i].type))) * 1099511628211ull;
+    }
+    signatures |= 1; // never 0, which is for unchecked
+
+    // Brings a function that is about to be used up to its unit's row, if
+    // it is out of date, and parses its body the first time.
+    auto prepare = [&](size_t i) -> Function_state& {
+      Function& func = functions[i];
+      Function_state& st = state(i);
+      if (!st.parsed || st.checked != signatures || !st.folded || !st.parse_error.empty() ||
+	  !st.check_error.empty() || !st.fold_error.empty()){
+	catch_up(func, st, owners[i].unit->row);
+      }
+      if (!st.parsed){
+	st.parsed = true;
+	try {
+	  parse_body(func);
+	  Tokens& body = func.block.tokens();
+	  for (auto& e : func.ast.exprs){
+	    if (e.kind == Expr::Kind::Call) st.calls.push_back(body[e.token].atom);
+	  }
+	} catch (Compile_error& e){
+	  st.parse_error = std::move(e.message);
+	}
+      }
+      return st;
+    };
+
+    // the walk of eliminate_dead_functions(), so that the same body error is met first
+    Atom main_atom = atoms.intern("main");
+    std::vector<bool> live(n, false);
+    std::vector<size_t> worklist;
+    auto mark = [&](size_t i){
+      if (live[i]) return;
+      live[i] = true;
+      worklist.push_back(i);
+    };
+    for (size_t i = 0; i < n; ++i){
+      if (functions[i].exported || (functions[i].name_atom == main_atom && !functions[i].imported)) mark(i);
+    }
+    if (worklist.empty()) live.assign(n, true);
+    while (!worklist.empty()){
+      size_t i = worklist.back();
+      worklist.pop_back();
+      if (skipped(i)) continue;
+      Function_state& st = prepare(i);
+      if (!st.parse_error.empty()) fatal_error(st.parse_error);
+      for (Atom call : st.calls){
+	Symbol* sym = symbols.lookup(call);
+	if (sym && sym->kind == Symbol::Kind::Function) mark(size_t(sym->index));
+      }
+    }
+
+    std::string report;
+    for (size_t i = 0; i < n; ++i){
+      if (!live[i] || skipped(i)) continue;
+      Function_state& st = prepare(i);
+      if (st.parse_error.empty() && st.checked != signatures){
+	st.checked = signatures;
+	st.check_error.clear();
+	st.folded = false;
+	try {
+	  check_function(checker, functions[i]);
+	} catch (Compile_error& e){
+	  st.check_error = std::move(e.message);
+	}
+      }
+      report += st.parse_error + st.check_error;
+    }
+    if (!report.empty()) fatal_error(report);
+
+    // a call folds to another constant when its callee, or a function that
+    // calls, changed
+    std::vector<std::vector<size_t>> callers(n);
+    std::vector<size_t> changed;
+    for (size_t i = 0; i < n; ++i){
+      if (!live[i] || skipped(i)) continue;
+      for (Atom call : state(i).calls){
+	Symbol* sym = symbols.lookup(call);
+	if (sym && sym->kind == Symbol::Kind::Function) callers[size_t(sym->index)].push_back(i);
+      }
+      if (!state(i).folded) changed.push_back(i);
+    }
+    while (!changed.empty()){
+      size_t i = changed.back();
+      changed.pop_back();
+      for (size_t caller : callers[i]){
+	if (!state(caller).folded) continue;
+	state(caller).folded = false;
+	changed.push_back(caller);
+      }
+    }
+    Comptime ct;
+    for (size_t i = 0; i < n; ++i){
+      if (!live[i] || skipped(i)) continue;
+      Function_state& st = state(i);
+      if (!st.folded){
+	catch_up(functions[i], st, owners[i].unit->row);
+	st.folded = true;
+	st.fold_error.clear();
+	try {
+	  fold_function(ct, functions[i]);
+	} catch (Compile_error& e){
+	  st.fold_error = std::move(e.message);
+	}
+      }
+      report += st.fold_error;
+    }
+    if (!report.empty()) fatal_error(report);
+  }
+
+  // Checks the file unless its check is current. Returns false when the
+  // check has to wait for the build of the module `waiting_for`.
+  bool check(Cached_file& file, std::string& waiting_for){
+    if (file.checked) return true;
+    std::vector<Owner> owners;
+    bool pending = false;
+    try {
+      file.source.lex_stale();
+      update_units(file);
+      link_program(file, owners);
+      check_linked(owners);
+      file.status = 0;
+      file.output.clear();
+    } catch (Compile_error& e){
+      file.status = 1;
+      file.output = e.message;
+    } catch (Module_build_pending& build){
+      waiting_for = build.source_path;
+      pending = true;
+    }
+    std::vector<std::string> imports;
+    for (auto& module : imported_modules) imports.push_back(canonical(module.source_path));
+    unlink_program(owners);
+    if (pending) return false;
+    file.checked = true;
+    for (auto& source : imports) watch_dir(fs::path(source).parent_path().string());
+    file.imports = std::move(imports);
+    return true;
+  }
+
+  // Parses the client's complete request and answers it.
+  void start_request(Client& client){
+    const std::string& request = client.request;
+    std::string header = str::lpop_until(request, '\n');
+    client.command = str::lpop_until(header, ' ');
+    client.path = canonical(header.size() > client.command.size() ? header.substr(client.command.size() + 1) : "");
+
+    if (client.command == "stop"){
+      running = false;
+      respond(client, "0\n");
+      return;
+    }
+    if (client.command != "check" && client.command != "compile" && client.command != "edit"){
+      respond(client, FMT("1\nERROR: Unknown daemon command `{}`\n", client.command));
+      return;
+    }
+
+    Cached_file& file = load_file(client.path);
+    std::string_view body = request;
+    body.remove_prefix(std::min(body.size(), header.size() + 1));
+    if (client.command == "edit"){
+      size_t line_end = body.find('\n');
+      char* end = nullptr;
+      std::string numbers(body.substr(0, line_end));
+      size_t offset = std::strtoull(numbers.c_str(), &end, 10);
+      size_t removed = std::strtoull(end, &end, 10);
+      if (line_end == std::string_view::npos || end == numbers.c_str() || *end != '\0'){
+	respond(client, "1\nERROR: An edit request expects \"<offset> <removed>\" on its second line\n");
+	return;
+      }
+      if (offset > file.source.size || removed > file.source.size - offset){
+	respond(client, FMT("1\nERROR: Edit of {} bytes at offset {} is out of range of `{}` ({} bytes)\n", removed, offset, client.path, file.source.size));
+	return;
+      }
+      apply_edit(file, client.path, offset, removed, body.substr(line_end + 1));
+    }
+    if (client.command == "compile"){
+      client.exe = str::lpop_until(std::string(body), '\n');
+      if (client.exe.empty()) client.exe = fs::path(client.path).replace_extension().string();
+    }
+    answer(client);
+  }
+
+  // Answers a parsed request, or leaves the client waiting for a build.
+  void answer(Client& client){
+    Cached_file& file = load_file(client.path);
+    if (!check(file, client.module)){
+      client.waiting = true;
+      return;
+    }
+    client.module.clear();
+    if (client.command == "compile" && file.status == 0){
+      start_compile(client, file);
+      return;
+    }
+    respond(client, FMT("{}\n{}", file.status, file.output));
+  }
+
+  void respond(Client& client, std::string response){
+    client.response = std::move(response);
+    client.answered = true;
+    client.waiting = false;
+    client.deadline = client_deadline();
+    write_client(client);
+  }
+
+  // Writes the C code of the checked file and starts the C compiler on it.
+  void start_compile(Client& client, Cached_file& file){
+    std::vector<Owner> owners;
+    Program program;
+    try {
+      link_program(file, owners);
+      program = Program{functions, symbols, imported_modules};
+    } catch (Compile_error& e){
+      unlink_program(owners);
+      respond(client, FMT("1\n{}", e.message));
+      return;
+    } catch (Module_build_pending& build){
+      // a module went stale since the check
+      unlink_program(owners);
+      client.module = build.source_path;
+      client.waiting = true;
+      return;
+    }
+    unlink_program(owners);
+
+    std::vector<std::string> args;
+    load_program(std::move(program));
+    try {
+      eliminate_dead_functions(true);
+      args = c_compile_command(client.exe);
+    } catch (Compile_error& e){
+      take_program();
+      respond(client, FMT("1\n{}", e.message));
+      return;
+    }
+    take_program();
+    Build build;
+    build.output = FMT("[CMD] {}\n", command_line(args));
+    build.client = client.fd;
+    if (!start_build(build, args)){
+      respond(client, FMT("1\n{}ERROR: C compiler failed with status -1\n", build.output));
+      return;
+    }
+    client.waiting = true;
+  }
+
+  bool start_build(Build& build, const std::vector<std::string>& args){
+    build.pid = spawn_process(args, &build.fd);
+    if (build.pid < 0) return false;
+    fcntl(build.fd, F_SETFL, O_NONBLOCK);
+    builds.push_back(std::move(build));
+    return true;
+  }
+
+  // The build_module hook: starts `hash --module` for a stale import and
+  // has the check wait for it, then hands the check its exit status.
+  int build_module_in_background(const std::string& source_path){
+    auto built = built_modules.find(source_path);
+    if (built != built_modules.end()) return built->second;
+    for (auto& build : builds){
+      if (build.module == source_path) return MODULE_BUILD_PENDING;
+    }
+    Build build;
+    build.module = source_path;
+    return start_build(build, {self_exe, "--module", source_path}) ? MODULE_BUILD_PENDING : -1;
+  }
+
+  void read_build(Build& build){
+    char buf[4096];
+    ssize_t n;
+    while ((n = read(build.fd, buf, sizeof(buf))) > 0){
+      build.output.append(buf, size_t(n));
+    }
+    if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) n = 0;
+    if (n == 0){
+      // the child closed its output as it exited
+      close(build.fd);
+      build.status = wait_process(build.pid);
+      build.exited = true;
+    }
+  }
+
+  void finish_build(Build& build){
+    if (build.module.empty()){
+      for (auto& client : clients){
+	if (client.fd != build.client || !client.waiting) continue;
+	if (build.status != 0) build.output += FMT("ERROR: C compiler failed with status {}\n", build.status);
+	respond(client, FMT("{}\n{}", build.status != 0 ? 1 : 0, build.output));
+      }
+      return;
+    }
+    // the output of a module build goes where it would when built in place
+    print("{}", build.output);
+    built_modules[build.module] = build.status;
+    for (auto& client : clients){
+      if (client.waiting && client.module == build.module) answer(client);
+    }
+    built_modules.erase(build.module);
+  }
+
+  static std::chrono::steady_clock::time_point client_deadline(){
+    return std::chrono::steady_clock::now() + std::chrono::milliseconds(DAEMON_CLIENT_TIMEOUT_MS);
+  }
+
+  void accept_clients(){
+    int fd;
+    while ((fd = accept4(server_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0){
+      clients.push_back(Client{fd});
+      clients.back().deadline = client_deadline();
+    }
+  }
+
+  void read_client(Client& client){
+    char buf[4096];
+    ssize_t n;
+    while ((n = read(client.fd, buf, sizeof(buf))) > 0){
+      client.request.append(buf, size_t(n));
+      client.deadline = client_deadline();
+    }
+    if (n < 0){
+      if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) client.done = true;
+      return;
+    }
+    // the client shut down its side: the request is complete
+    start_request(client);
+  }
+
+  void write_client(Client& client){
+    while (client.sent < client.response.size()){
+      // MSG_NOSIGNAL: a client that went away is an error here, not a SIGPIPE
+      ssize_t w = send(client.fd, client.response.data() + client.sent, client.response.size() - client.sent, MSG_NOSIGNAL);
+      if (w < 0){
+	if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) client.done = true;
+	return;
+      }
+      client.sent += size_t(w);
+      client.deadline = client_deadline();
+    }
+    client.done = true;
+  }
+
+  int run(){
+    errors_are_fatal = false;
+    declare_builtins();
+    parse_prelude();
+    prelude = take_program();
+    build_module = [this](const std::string& source_path){ return build_module_in_background(source_path); };
+
+    inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotify_fd < 0){
+      fprint(std::cerr, "ERROR: inotify_init1 failed: {}\n", strerror(errno));
+      return 1;
+    }
+    watch_tree(canonical(fs::current_path().string()));
+
+    server_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, DAEMON_SOCKET, sizeof(addr.sun_path) - 1);
+    unlink(DAEMON_SOCKET);
+    if (server_fd < 0 || bind(server_fd, (sockaddr*)&addr, sizeof(addr)) < 0 || listen(server_fd, 16) < 0){
+      fprint(std::cerr, "ERROR: Could not listen on `{}`: {}\n", DAEMON_SOCKET, strerror(errno));
+      return 1;
+    }
+    print("Hash daemon listening on {}\n", (fs::current_path() / DAEMON_SOCKET).string());
+
+    std::vector<pollfd> fds;
+    while (running){
+      fds = {{inotify_fd, POLLIN, 0}, {server_fd, POLLIN, 0}};
+      int timeout = -1;
+      auto now = std::chrono::steady_clock::now();
+      for (auto& client : clients){
+	fds.push_back({client.fd, short(client.waiting ? 0 : client.answered ? POLLOUT : POLLIN), 0});
+	if (client.waiting) continue;
+	auto left = std::chrono::duration_cast<std::chrono::milliseconds>(client.deadline - now).count();
+	left = std::max<decltype(left)>(left, 0);
+	if (timeout < 0 || left < timeout) timeout = int(left);
+      }
+      size_t polled_builds = builds.size();
+      for (auto& build : builds){
+	fds.push_back({build.fd, POLLIN, 0});
+      }
+      if (poll(fds.data(), nfds_t(fds.size()), timeout) < 0){
+	if (errno == EINTR) continue;
+	break;
+      }
+      // apply file changes before answering, so a save followed by a request is never stale
+      if (fds[0].revents & POLLIN) handle_fs_events();
+      now = std::chrono::steady_clock::now();
+      for (size_t i = 0; i < clients.size() && running; ++i){
+	Client& client = clients[i];
+	short revents = fds[i + 2].revents;
+	if (revents & POLLNVAL){
+	  client.done = true;
+	} else if (client.waiting){
+	  if (revents & (POLLHUP | POLLERR)) client.done = true;
+	} else if (!client.answered && (revents & (POLLIN | POLLHUP | POLLERR))){
+	  read_client(client);
+	} else if (client.answered && (revents & (POLLOUT | POLLHUP | POLLERR))){
+	  write_client(client);
+	}
+	if (!client.waiting && now >= client.deadline) client.done = true;
+      }
+      // answering clients may have started builds that were not polled
+      for (size_t i = 0; i < polled_builds; ++i){
+	if (fds[i + 2 + clients.size()].revents) read_build(builds[i]);
+      }
+      std::vector<Build> exited;
+      for (size_t i = 0; i < builds.size(); ){
+	if (builds[i].exited){
+	  exited.push_back(std::move(builds[i]));
+	  builds.erase(builds.begin() + i);
+	} else {
+	  ++i;
+	}
+      }
+      for (auto& build : exited) finish_build(build);
+      std::erase_if(clients, [](Client& client){
+	if (client.done) close(client.fd);
+	return client.done;
+      });
+      if (running && (fds[1].revents & POLLIN)) accept_clients();
+    }
+
+    for (auto& client : clients) close(client.fd);
+    for (auto& build : builds) close(build.fd);
+    close(server_fd);
+    close(inotify_fd);
+    unlink(DAEMON_SOCKET);
+    return 0;
+  }
+};
+
+int run_daemon(){
+  Daemon daemon;
+  return daemon.run();
+}
+
+// `body` follows the request line, e.g. the offsets and text of an edit.
+int run_client(const std::string& command, const std::string& filename, const std::string& body){
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  sockaddr_un addr{};
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, DAEMON_SOCKET, sizeof(addr.sun_path) - 1);
+  if (fd < 0 || connect(fd, (sockaddr*)&addr, sizeof(addr)) < 0){
+    fprint(std::cerr, "ERROR: Could not connect to the hash daemon at `{}`: {}\n", DAEMON_SOCKET, strerror(errno));
+    return 1;
+  }
+  std::string request = FMT("{} {}\n{}", command, fs::absolute(fs::path(filename)).string(), body);
+  if (write(fd, request.data(), request.size()) != ssize_t(request.size()) || shutdown(fd, SHUT_WR) < 0){
+    fprint(std::cerr, "ERROR: Could not send request to the hash daemon\n");
+    return 1;
+  }
+  std::string response;
+  char buf[4096];
+  ssize_t n;
+  while ((n = read(fd, buf, sizeof(buf))) > 0){
+    response.append(buf, size_t(n));
+  }
+  close(fd);
+
+  std::string status = str::lpop_until(response, '\n');
+  fprint(std::cerr, "{}", response.substr(std::min(response.size(), status.size() + 1)));
+  return status == "0" ? 0 : 1;
+}
+#else
+int run_daemon(){
+  fprint(std::cerr, "ERROR: --daemon is only supported on Linux\n");
+  return 1;
+}
+
+int run_client(const std::string& command, const std::string& filename, const std::string& body){
+  fprint(std::cerr, "ERROR: --client is only supported on Linux\n");
+  return 1;
+}
+#endif
+
+void dump_tokens(Tokens& tokens){
+  print("Tokens:\n");
+  for (auto& token : tokens){
+    print("{}:{}\n", token.loc.as_str(), token.as_str());
+  }
+}
+
+int main(int argc, char *argv[]) {
+  // for (size_t i = 0; i <= 127; ++i){
+  //   print("`{}` {}\n", char(i), (ch::isdigit(char(i)) ? "is digit" : ""));
+  // }
+
+  // return 0;
+
+  ARG();
+  self_exe = arg.pop();
+  std::string filename = "main.hash";
+  int jobs = 1;
+  bool only_dump_tokens = false;
+  bool only_signatures = false;
+  std::string emit_c_file;
+  std::string output;
+  bool as_module = false;
+  while (arg){
+    std::string a = arg.pop();
+    if (a == "-j" || a == "--jobs"){
+      std::string n = arg.pop();
+      jobs = n.empty() ? 0 : std::atoi(n.c_str());
+      if (jobs <= 0) jobs = int(std::max(1u, std::thread::hardware_concurrency()));
+    } else if (a == "--dump-tokens"){
+      only_dump_tokens = true;
+    } else if (a == "--signatures"){
+      only_signatures = true;
+    } else if (a == "--emit-c"){
+      emit_c_file = arg.pop();
+    } else if (a == "-o"){
+      output = arg.pop();
+    } else if (a == "--module"){
+      as_module = true;
+    } else if (a == "--mem-report"){
+      if (!mem::profiling.exchange(true)) std::atexit(mem::report);
+    } else if (a == "--daemon"){
+      return run_daemon();
+    } else if (a == "--client"){
+      std::string command = arg.pop();
+      if (command.empty()){
+	fprint(std::cerr, "ERROR: --client expects a command: check, compile, edit or stop\n");
+	return 1;
+      }
+      if (arg) filename = arg.pop();
+      std::string body;
+      if (command == "edit"){
+	// --client edit <file> <offset> <removed> <inserted text>
+	std::string offset = arg.pop();
+	std::string removed = arg.pop();
+	std::string inserted = arg.pop();
+	body = FMT("{} {}\n{}", offset, removed, inserted);
+      } else if (command == "compile" && arg){
+	// --client compile <file> [executable]
+	body = fs::absolute(fs::path(arg.pop())).string() + "\n";
+      }
+      return run_client(command, filename, body);
+    } else {
+      filename = a;
+    }
+  }
+
+  // Bodies are lexed when dead function elimination reaches them, so unused
+  // functions cost only their signature. --signatures never needs them, so
+  // it does not lex in parallel.
+  bool lazy_bodies = !only_dump_tokens;
+  Tokens tokens = parse_source_file(filename, only_signatures ? 1 : jobs, lazy_bodies);
+  if (only_dump_tokens){
+    dump_tokens(tokens);
+    return 0;
+  }
+  declare_builtins();
+  parse_prelude();
+  parse_tokens(tokens);
+  if (only_signatures){
+    // header-only: function bodies are never lexed
+    for (auto& func : functions){
+      if (func.builtin != -1 || func.token.loc.file_path == PRELUDE_PATH) continue;
+      print("{}: {}: {}\n", func.token.loc.as_str(), func.name, type_table.name(func.type));
+    }
+    return 0;
+  }
+  eliminate_dead_functions();
+  check_functions(jobs);
+  fold_comptime();
+
+  if (as_module){
+    std::string source_path = fs::absolute(fs::path(filename)).string();
+    write_interface(module_file(source_path, INTERFACE_EXT));
+    if (emit_c_file.empty()) emit_c_file = module_file(source_path, "c");
+  }
+  if (!emit_c_file.empty()){
+    std::ofstream ofs(emit_c_file, std::ios::binary);
+    ofs << emit_c();
+  }
+  if (!output.empty()){
+    return build_executable(output);
+  }
 
   return 0;
 }
@@ -0,0 +1,16 @@
+// Generated by premake5.lua from src/prelude.hash. Do not edit.
+#pragma once
+
+static constexpr std::string_view prelude_source = R"hash(func square(x: int) -> int {
+  return x * x;
+}
+func cube(x: int) -> int {
+  return x * x * x;
+}
+func wrap(x: int, n: int) -> int {
+  return (x % n + n) % n;
+}
+func lerp(a: float, b: float, t: float) -> float {
+  return a + (b - a) * t;
+}
+)hash";
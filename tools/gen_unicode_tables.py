@@ -0,0 +1,58 @@
+#!/usr/bin/env python3
+# Generates src/unicode_tables.hpp: XID_Start and XID_Continue for the lexer,
+# from the Unicode database of the running Python (str.isidentifier() is
+# defined by those two properties, plus `_` as a start character).
+#
+# usage: python3 tools/gen_unicode_tables.py
+import os
+import unicodedata
+
+BLOCK = 256
+LIMIT = 0x110000
+
+def main():
+    start = [chr(c).isidentifier() and c != ord('_') for c in range(LIMIT)]
+    cont = [('a' + chr(c)).isidentifier() for c in range(LIMIT)]
+
+    leaves = {}
+    index = []
+    for b in range(LIMIT // BLOCK):
+        words = []
+        for bits in (start, cont):
+            for w in range(BLOCK // 64):
+                base = b * BLOCK + w * 64
+                words.append(sum(1 << i for i in range(64) if bits[base + i]))
+        index.append(leaves.setdefault(tuple(words), len(leaves)))
+    empty = leaves[tuple([0] * (2 * BLOCK // 64))]
+    while index and index[-1] == empty:
+        index.pop()
+    assert len(leaves) < 256
+
+    out = []
+    out.append(f"// Generated by tools/gen_unicode_tables.py from the Unicode {unicodedata.unidata_version} database. Do not edit.")
+    out.append("// XID_Start and XID_Continue as a two-level table: xid_index maps each block")
+    out.append(f"// of {BLOCK} code points to a row of xid_leaves, whose first four words hold the")
+    out.append("// block's XID_Start bits and the last four its XID_Continue bits. Code points")
+    out.append("// past the last block have neither property.")
+    out.append("#pragma once")
+    out.append("#include <cstdint>")
+    out.append("")
+    out.append(f"#define XID_BLOCK_BITS {BLOCK.bit_length() - 1}")
+    out.append(f"#define XID_BLOCKS {len(index)}")
+    out.append("")
+    out.append("static constexpr uint8_t xid_index[XID_BLOCKS] = {")
+    for i in range(0, len(index), 24):
+        out.append("  " + ", ".join(str(x) for x in index[i:i + 24]) + ",")
+    out.append("};")
+    out.append("")
+    out.append(f"static constexpr uint64_t xid_leaves[{len(leaves)}][{2 * BLOCK // 64}] = {{")
+    for words in leaves:
+        out.append("  {" + ", ".join(f"0x{w:016x}" for w in words) + "},")
+    out.append("};")
+
+    path = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "src", "unicode_tables.hpp")
+    with open(path, "w", newline="\n") as f:
+        f.write("\n".join(out) + "\n")
+
+if __name__ == "__main__":
+    main()